@@ -59,6 +59,10 @@
 
 #include "bc7_common_encoder.h"
 
+#if !defined(ASPM_GPU) && !defined(ASPM)
+#include <mutex>
+#endif
+
 #ifndef ASPM
 //---------------------------------------------
 // Predefinitions for GPU and CPU compiled code
@@ -137,16 +141,10 @@ CMP_EXPORT CGU_INT bc7_isa()
     return -1;
 }
 
-CMP_EXPORT void init_BC7ramps()
+#ifndef ASPM_GPU
+// Fills BC7EncodeRamps, only ever called through init_BC7ramps.
+static void build_BC7ramps()
 {
-#ifdef ASPM_GPU
-#else
-    CMP_STATIC CGU_BOOL g_rampsInitialized = FALSE;
-    if (g_rampsInitialized == TRUE)
-        return;
-    g_rampsInitialized       = TRUE;
-    BC7EncodeRamps.ramp_init = TRUE;
-
     //bc7_isa(); ASPM_PRINT((" INIT Ramps\n"));
 
     CGU_INT bits;
@@ -295,6 +293,26 @@ CMP_EXPORT void init_BC7ramps()
 
         }  //bits<BIT_RANGE
     }      //clogBC7<LOG_CL_RANGE
+
+    BC7EncodeRamps.ramp_init = TRUE;
+}
+#endif
+
+// Builds the encoder tables the first time it is called. Encoders on several threads may create their options at
+// the same time, so on the CPU this goes through call_once, which also makes every caller wait until the tables are
+// complete rather than letting the first one flag them as built before filling them.
+CMP_EXPORT void init_BC7ramps()
+{
+#if defined(ASPM_GPU)
+#elif defined(ASPM)
+    CMP_STATIC CGU_BOOL g_rampsInitialized = FALSE;
+    if (g_rampsInitialized == TRUE)
+        return;
+    build_BC7ramps();
+    g_rampsInitialized = TRUE;
+#else
+    static std::once_flag rampsOnce;
+    std::call_once(rampsOnce, build_BC7ramps);
 #endif
 }
 
@@ -3587,16 +3605,8 @@ int CMP_CDECL CompressBlockBC7(const unsigned char* srcBlock, unsigned int srcSt
 
 int CMP_CDECL DecompressBlockBC7(const unsigned char cmpBlock[16], unsigned char srcBlock[64], const void* options = NULL)
 {
-    BC7_Encode* u_BC7Encode      = (BC7_Encode*)options;
-    BC7_Encode  BC7EncodeDefault = {0};  // for q = 0.05
-    if (u_BC7Encode == NULL)
-    {
-        // set for q = 1.0
-        u_BC7Encode = &BC7EncodeDefault;
-        SetDefaultBC7Options(u_BC7Encode);
-        init_BC7ramps();
-    }
-    DecompressBC7_internal((CGU_UINT8(*)[4])srcBlock, (CGU_UINT8*)cmpBlock, u_BC7Encode);
+    // Decoding reads neither the options nor the encoder tables, so there is nothing to set up per block.
+    DecompressBC7_internal((CGU_UINT8(*)[4])srcBlock, (CGU_UINT8*)cmpBlock, (const BC7_Encode*)options);
     return CGU_CORE_OK;
 }
 #endif
@@ -0,0 +1,509 @@
+#include "batch.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#include <fmt/core.h>
+
+#include "hash.h"
+#include "payload.h"
+#include "pixel_buffer.h"
+#include "pipeline.h"
+#include "probes.h"
+#include "stats.h"
+#include "thread_pool.h"
+
+namespace fs = std::filesystem;
+
+// Roughly how many blocks a single decode task of a large texture covers.
+static constexpr int BlocksPerBand = 16384;
+
+PipelineOptions::PipelineOptions() {
+    unsigned cores = std::max(std::thread::hardware_concurrency(), 1u);
+    readBackend = ParseReadBackend("auto");
+    decodeThreads = cores;
+    encodeThreads = cores;
+    queueDepth = std::max<size_t>(8, cores);
+}
+
+PipelineOptions ExtractPipelineOptions(std::deque<std::string> &args) {
+    PipelineOptions ret;
+    for (auto I = args.begin(); I != args.end();) {
+        if (*I == "--io") {
+            if (I + 1 == args.end()) {
+                throw std::runtime_error(fmt::format("missing value for option {}", *I));
+            }
+            ret.readBackend = ParseReadBackend(I[1]);
+            I = args.erase(I, I + 2);
+        } else if (*I == "--threads" || *I == "--read-threads" || *I == "--read-depth" || *I == "--decode-threads" ||
+                   *I == "--encode-threads" || *I == "--write-threads" || *I == "--queue-depth") {
+            if (I + 1 == args.end()) {
+                throw std::runtime_error(fmt::format("missing value for option {}", *I));
+            }
+            int value = IntoInt(I[1]);
+            if (value <= 0) {
+                throw std::runtime_error(fmt::format("value for option {} must be positive: {}", *I, value));
+            }
+            if (*I == "--threads") {
+                ret.decodeThreads = ret.encodeThreads = value;
+            } else if (*I == "--read-threads") {
+                ret.readThreads = value;
+            } else if (*I == "--read-depth") {
+                ret.readDepth = value;
+            } else if (*I == "--decode-threads") {
+                ret.decodeThreads = value;
+            } else if (*I == "--encode-threads") {
+                ret.encodeThreads = value;
+            } else if (*I == "--write-threads") {
+                ret.writeThreads = value;
+            } else {
+                ret.queueDepth = value;
+            }
+            I = args.erase(I, I + 2);
+        } else {
+            ++I;
+        }
+    }
+    return ret;
+}
+
+namespace {
+struct LoadedItem {
+    size_t job;
+    // The read buffer, empty for files that are used in place from an archive.
+    PixelBuffer data;
+    gsl::span<uint8_t const> bytes;
+    uint64_t sourceHash;
+};
+
+struct DecodedItem {
+    size_t job;
+    Image image;
+    uint64_t sourceHash;
+};
+
+struct EncodedItem {
+    size_t job;
+    std::vector<EncodedOutput> outputs;
+    uint64_t sourceHash;
+};
+
+// One frame of a stream on its way through all the stages, failed frames included so that the output stays in step.
+struct StreamFrame {
+    size_t index{};
+    PixelBuffer data;
+    std::optional<Image> image;
+    std::vector<EncodedOutput> outputs;
+    bool failed{};
+};
+} // namespace
+
+// File and image buffers allocated fresh rather than taken from a pool, which should stay near a few per thread.
+static void PrintPixelBufferReport() {
+    auto counters = GetPixelBufferCounters();
+    fprintf(stderr, "buffers: %zu allocated (%.1f MiB), %zu reused\n", counters.allocated,
+            counters.allocatedBytes / double(1 << 20), counters.reused);
+}
+
+// Decodes from the source bytes, or the buffer that a compressed file was unpacked into. Large atlases are split into
+// bands of block rows that idle workers can steal.
+static Image DecodeSource(gsl::span<uint8_t const> bytes, std::optional<Rect> crop, ConvertOptions const &options,
+                          std::string const &name, PayloadResolver &resolver, ThreadPool &bandPool) {
+    PayloadScratch scratch;
+    auto dds = resolver.Resolve(bytes, scratch, name);
+    LoadedTexture src = LoadTexture(dds, name);
+    TextureDecoder decoder(src.tex, crop, options, name);
+
+    int rows = decoder.BlockRowCount();
+    int rowsPerBand = std::max(1, BlocksPerBand / std::max(1, decoder.BlocksPerRow()));
+    if (rows <= rowsPerBand) {
+        decoder.DecodeBlockRows(0, rows);
+    } else {
+        TaskGroup bands(bandPool);
+        for (int row = 0; row < rows; row += rowsPerBand) {
+            bands.Run([&, row] { decoder.DecodeBlockRows(row, std::min(row + rowsPerBand, rows)); });
+        }
+        bands.Wait();
+    }
+    return std::move(decoder.GetImage());
+}
+
+BatchSummary RunBatch(std::vector<ConvertJob> &jobs, ConvertOptions const &options,
+                      PipelineOptions const &pipelineOptions, Manifest const *previous,
+                      GgpkArchive const *archive) {
+    std::string const optionsKey = ConvertOptionsKey(options);
+    uint64_t const optionsHash = HashBytes(optionsKey.data(), optionsKey.size());
+
+    std::atomic<size_t> converted{0}, skipped{0}, failed{0};
+    std::atomic<uintmax_t> bytesRead{0}, bytesWritten{0};
+    std::mutex errorMutex;
+    auto fail = [&](size_t index, std::exception const &e) {
+        ++failed;
+        PROBE(request__done, jobs[index].srcPath.c_str(), index, 1, uint64_t(0));
+        std::lock_guard lk(errorMutex);
+        fprintf(stderr, "error: %s\n", e.what());
+    };
+
+    // Bands of large textures are spread over this pool, with the decode stage threads helping out.
+    ThreadPool bandPool(pipelineOptions.decodeThreads);
+
+    PayloadResolver resolver(options.redirectRoot.value_or("."), archive);
+    BoundedQueue<LoadedItem> loaded(pipelineOptions.queueDepth);
+    BoundedQueue<DecodedItem> decoded(pipelineOptions.queueDepth);
+    BoundedQueue<EncodedItem> encoded(pipelineOptions.queueDepth);
+
+    auto startTime = std::chrono::steady_clock::now();
+    Pipeline pipeline;
+
+    // Unchanged files are skipped, first by size and time stamp before reading and then by content after.
+    auto outputsExist = [&](ConvertJob const &job) {
+        auto paths = OutputPaths(job.dstPath, options);
+        return std::all_of(paths.begin(), paths.end(), [](auto &path) { return fs::exists(path); });
+    };
+    auto stampUnchanged = [&](ConvertJob &job) {
+        auto const *prev = previous ? previous->Find(job.key) : nullptr;
+        if (prev && !prev->redirect && prev->optionsHash == optionsHash && prev->size == job.size &&
+            prev->mtime == job.mtime && outputsExist(job)) {
+            job.result = *prev;
+            return true;
+        }
+        return false;
+    };
+    auto contentUnchanged = [&](ConvertJob &job, uint64_t sourceHash) {
+        auto const *prev = previous ? previous->Find(job.key) : nullptr;
+        if (prev && prev->optionsHash == optionsHash && prev->sourceHash == sourceHash && outputsExist(job)) {
+            job.result = ManifestEntry{job.size, job.mtime, sourceHash, optionsHash, prev->outputHash, job.redirect};
+            return true;
+        }
+        return false;
+    };
+
+    // Hashes what was read and passes it on, unless the contents turn out to be unchanged. Redirects also hash the
+    // texture they point at, so that changing it converts them again.
+    auto accept = [&](size_t index, PixelBuffer data, gsl::span<uint8_t const> bytes, auto &emit) {
+        bytesRead += bytes.size();
+        jobs[index].redirect = DetectPayload(bytes) == PayloadKind::Redirect;
+        uint64_t sourceHash = 0;
+        if (previous) {
+            sourceHash = HashBytes(bytes.data(), bytes.size());
+            if (jobs[index].redirect) {
+                uint64_t targetHash = resolver.RedirectHash(bytes);
+                sourceHash = HashBytes(&targetHash, sizeof(targetHash), sourceHash);
+            }
+        }
+        if (contentUnchanged(jobs[index], sourceHash)) {
+            ++skipped;
+            return;
+        }
+        emit(LoadedItem{index, std::move(data), bytes, sourceHash});
+    };
+
+    // Each read thread keeps its reader full of jobs taken from the shared list. Files in the archive need no reading
+    // and are passed on straight away.
+    std::atomic<size_t> nextJob{0};
+    pipeline.AddSource("read", pipelineOptions.readThreads, loaded, [&](auto &emit) {
+        std::unique_ptr<FileReader> reader;
+        try {
+            reader = MakeFileReader(pipelineOptions.readBackend, pipelineOptions.readDepth);
+        } catch (std::exception &) {
+            reader = MakeFileReader(ReadBackend::Threads, pipelineOptions.readDepth);
+        }
+        std::vector<FileRead> done;
+        while (true) {
+            while (reader->CanSubmit()) {
+                size_t index = nextJob++;
+                if (index >= jobs.size()) {
+                    break;
+                }
+                try {
+                    if (stampUnchanged(jobs[index])) {
+                        ++skipped;
+                    } else if (IsGgpkPath(jobs[index].srcPath)) {
+                        std::vector<uint8_t> unused;
+                        accept(index, {}, ReadSource(jobs[index].srcPath, archive, unused), emit);
+                    } else {
+                        reader->Submit(index, jobs[index].srcPath);
+                    }
+                } catch (std::exception &e) {
+                    fail(index, e);
+                }
+            }
+            if (!reader->Pending()) {
+                break;
+            }
+            done.clear();
+            try {
+                PhaseTimer timer(Phase::Read);
+                reader->Collect(done);
+            } catch (std::exception &e) {
+                // The reader is unusable, fail whatever it still had and carry on with plain reads.
+                failed += reader->Pending();
+                {
+                    std::lock_guard lk(errorMutex);
+                    fprintf(stderr, "error: %s\n", e.what());
+                }
+                reader = MakeFileReader(ReadBackend::Threads, pipelineOptions.readDepth);
+                continue;
+            }
+            for (auto &read : done) {
+                try {
+                    if (read.error) {
+                        std::rethrow_exception(read.error);
+                    }
+                    // Moving the buffer keeps its storage, so the span stays valid.
+                    gsl::span<uint8_t const> bytes(read.data.data(), read.data.size());
+                    CountBytesRead(bytes.size());
+                    accept(read.tag, std::move(read.data), bytes, emit);
+                } catch (std::exception &e) {
+                    fail(read.tag, e);
+                }
+            }
+        }
+    });
+
+    pipeline.AddStage("decode", pipelineOptions.decodeThreads, loaded, decoded,
+                      [&](LoadedItem item) -> std::optional<DecodedItem> {
+                          auto &job = jobs[item.job];
+                          try {
+                              Image image =
+                                  DecodeSource(item.bytes, job.crop, options, job.srcPath, resolver, bandPool);
+                              item.data = PixelBuffer();
+                              return DecodedItem{item.job, std::move(image), item.sourceHash};
+                          } catch (std::exception &e) {
+                              fail(item.job, e);
+                              return {};
+                          }
+                      });
+
+    pipeline.AddStage("encode", pipelineOptions.encodeThreads, decoded, encoded,
+                      [&](DecodedItem item) -> std::optional<EncodedItem> {
+                          auto &job = jobs[item.job];
+                          try {
+                              EncodedItem ret{item.job, {}, item.sourceHash};
+                              size_t count = std::max<size_t>(options.sizes.size(), 1);
+                              for (size_t i = 0; i < count; ++i) {
+                                  ret.outputs.push_back(EncodeOutput(item.image, job.dstPath, options, i));
+                              }
+                              return ret;
+                          } catch (std::exception &e) {
+                              fail(item.job, e);
+                              return {};
+                          }
+                      });
+
+    pipeline.AddSink("write", pipelineOptions.writeThreads, encoded, [&](EncodedItem item) {
+        auto &job = jobs[item.job];
+        try {
+            uint64_t outputHash = 0, outputBytes = 0;
+            for (auto &output : item.outputs) {
+                if (fs::path parent = fs::path(output.path).parent_path(); !parent.empty()) {
+                    fs::create_directories(parent);
+                }
+                WriteFile(output.path, output.png);
+                bytesWritten += output.png.size();
+                outputBytes += output.png.size();
+                uint64_t hash = HashBytes(output.png.data(), output.png.size());
+                outputHash = HashBytes(&hash, sizeof(hash), outputHash);
+            }
+            job.result = ManifestEntry{job.size, job.mtime, item.sourceHash, optionsHash, outputHash, job.redirect};
+            ++converted;
+            PROBE(request__done, job.srcPath.c_str(), item.job, 0, outputBytes);
+        } catch (std::exception &e) {
+            fail(item.job, e);
+        }
+    });
+
+    pipeline.Wait();
+
+    BatchSummary ret;
+    ret.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    ret.converted = converted;
+    ret.skipped = skipped;
+    ret.failed = failed;
+    ret.bytesRead = bytesRead;
+    ret.bytesWritten = bytesWritten;
+
+    pipeline.PrintReport(stderr, ret.seconds);
+    PrintPixelBufferReport();
+    return ret;
+}
+
+// Frames are a little-endian 32-bit byte count followed by that many bytes.
+static constexpr uint32_t MaxFrameSize = 1u << 30;
+
+// False at a clean end of the stream, between frames.
+static bool ReadFrame(FILE *in, PixelBuffer &data) {
+    PhaseTimer timer(Phase::Read);
+    uint8_t prefix[4];
+    size_t got = fread(prefix, 1, sizeof(prefix), in);
+    if (got == 0 && !ferror(in)) {
+        return false;
+    }
+    if (got != sizeof(prefix)) {
+        throw std::runtime_error("truncated frame length on standard input");
+    }
+    uint32_t size = prefix[0] | prefix[1] << 8 | prefix[2] << 16 | uint32_t(prefix[3]) << 24;
+    if (size > MaxFrameSize) {
+        throw std::runtime_error(fmt::format("frame of {} bytes on standard input is too large", size));
+    }
+    data = PixelBuffer(size);
+    if (fread(data.data(), 1, size, in) != size) {
+        throw std::runtime_error("truncated frame on standard input");
+    }
+    CountBytesRead(size);
+    return true;
+}
+
+static void WriteFrame(FILE *out, gsl::span<uint8_t const> data) {
+    uint32_t size = static_cast<uint32_t>(data.size());
+    uint8_t prefix[4]{uint8_t(size), uint8_t(size >> 8), uint8_t(size >> 16), uint8_t(size >> 24)};
+    if (fwrite(prefix, 1, sizeof(prefix), out) != sizeof(prefix) ||
+        fwrite(data.data(), 1, data.size(), out) != data.size()) {
+        throw std::runtime_error("could not write frame to standard output");
+    }
+}
+
+BatchSummary RunStream(FILE *in, FILE *out, ConvertOptions const &options, PipelineOptions const &pipelineOptions,
+                       GgpkArchive const *archive) {
+    std::atomic<size_t> converted{0}, failed{0};
+    std::atomic<uintmax_t> bytesRead{0}, bytesWritten{0};
+    std::mutex errorMutex;
+    auto report = [&](std::exception const &e) {
+        std::lock_guard lk(errorMutex);
+        fprintf(stderr, "error: %s\n", e.what());
+    };
+
+    ThreadPool bandPool(pipelineOptions.decodeThreads);
+    PayloadResolver resolver(options.redirectRoot.value_or("."), archive);
+    BoundedQueue<StreamFrame> loaded(pipelineOptions.queueDepth);
+    BoundedQueue<StreamFrame> decoded(pipelineOptions.queueDepth);
+    BoundedQueue<StreamFrame> encoded(pipelineOptions.queueDepth);
+    size_t const outputCount = std::max<size_t>(options.sizes.size(), 1);
+
+    // Frames that have been read but not written yet are capped at enough to keep every decode and encode thread busy
+    // with a queue's worth waiting, so that a slow frame holds up the reader rather than having every frame after it
+    // pile up in the write stage until it is done.
+    size_t const window = pipelineOptions.queueDepth + pipelineOptions.decodeThreads + pipelineOptions.encodeThreads;
+    std::mutex windowMutex;
+    std::condition_variable windowSpace;
+    size_t written = 0;
+
+    auto startTime = std::chrono::steady_clock::now();
+    Pipeline pipeline;
+
+    // Frames arrive one after the other, so a single thread reads them.
+    pipeline.AddSource("read", 1, loaded, [&](auto &emit) {
+        try {
+            for (size_t index = 0;; ++index) {
+                {
+                    std::unique_lock lk(windowMutex);
+                    windowSpace.wait(lk, [&] { return index - written < window; });
+                }
+                StreamFrame frame;
+                frame.index = index;
+                if (!ReadFrame(in, frame.data)) {
+                    break;
+                }
+                bytesRead += frame.data.size();
+                emit(std::move(frame));
+            }
+        } catch (std::exception &e) {
+            // Nothing after a broken frame can be trusted, so that is where the stream ends.
+            ++failed;
+            report(e);
+        }
+    });
+
+    pipeline.AddStage("decode", pipelineOptions.decodeThreads, loaded, decoded,
+                      [&](StreamFrame frame) -> std::optional<StreamFrame> {
+                          try {
+                              frame.image = DecodeSource({frame.data.data(), frame.data.size()}, std::nullopt,
+                                                         options, fmt::format("frame {}", frame.index), resolver,
+                                                         bandPool);
+                          } catch (std::exception &e) {
+                              frame.failed = true;
+                              report(e);
+                          }
+                          frame.data = PixelBuffer();
+                          return frame;
+                      });
+
+    pipeline.AddStage("encode", pipelineOptions.encodeThreads, decoded, encoded,
+                      [&](StreamFrame frame) -> std::optional<StreamFrame> {
+                          try {
+                              for (size_t i = 0; !frame.failed && i < outputCount; ++i) {
+                                  frame.outputs.push_back(EncodeOutput(*frame.image, "-", options, i));
+                              }
+                          } catch (std::exception &e) {
+                              frame.failed = true;
+                              report(e);
+                          }
+                          frame.image.reset();
+                          return frame;
+                      });
+
+    // Encoded frames finish out of order, and are held back until all the frames before them have been written.
+    std::map<size_t, StreamFrame> waiting;
+    size_t nextFrame = 0;
+    pipeline.AddSink("write", 1, encoded, [&](StreamFrame frame) {
+        waiting.emplace(frame.index, std::move(frame));
+        for (auto I = waiting.begin(); I != waiting.end() && I->first == nextFrame; I = waiting.erase(I), ++nextFrame) {
+            auto &ready = I->second;
+            uint64_t frameBytes = 0;
+            try {
+                // A failed frame still gives one empty frame per output, so that readers can match inputs to outputs.
+                for (size_t i = 0; i < outputCount; ++i) {
+                    gsl::span<uint8_t const> png;
+                    if (!ready.failed) {
+                        png = ready.outputs[i].png;
+                    }
+                    WriteFrame(out, png);
+                    bytesWritten += png.size();
+                    frameBytes += png.size();
+                }
+                if (fflush(out) != 0) {
+                    throw std::runtime_error("could not write frame to standard output");
+                }
+                ++(ready.failed ? failed : converted);
+                PROBE(request__done, "-", ready.index, int(ready.failed), frameBytes);
+            } catch (std::exception &e) {
+                ++failed;
+                report(e);
+                PROBE(request__done, "-", ready.index, 1, frameBytes);
+            }
+        }
+        {
+            std::lock_guard lk(windowMutex);
+            written = nextFrame;
+        }
+        windowSpace.notify_one();
+    });
+
+    pipeline.Wait();
+
+    BatchSummary ret;
+    ret.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    ret.converted = converted;
+    ret.failed = failed;
+    ret.bytesRead = bytesRead;
+    ret.bytesWritten = bytesWritten;
+
+    pipeline.PrintReport(stderr, ret.seconds);
+    PrintPixelBufferReport();
+    return ret;
+}
+
+void PrintBatchSummary(BatchSummary const &summary, size_t jobCount) {
+    fprintf(stderr,
+            "converted %zu of %zu files (%zu unchanged) in %.2f s (%.1f files/s), read %ju bytes, wrote %ju bytes\n",
+            summary.converted, jobCount, summary.skipped, summary.seconds,
+            summary.seconds > 0.0 ? summary.converted / summary.seconds : 0.0, summary.bytesRead,
+            summary.bytesWritten);
+}
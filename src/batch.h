@@ -0,0 +1,76 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "convert.h"
+#include "file_reader.h"
+#include "ggpk.h"
+#include "manifest.h"
+
+struct ConvertJob {
+    std::string srcPath;
+    std::string dstPath;
+    std::optional<Rect> crop;
+
+    // Manifest bookkeeping, only used when RunBatch is given a previous manifest.
+    std::string key;
+    uintmax_t size{};
+    int64_t mtime{};
+    // Set by the read stage when the source turns out to be a redirect.
+    bool redirect{};
+    std::optional<ManifestEntry> result;
+};
+
+// Thread counts for the read, decode, encode and write stages and the capacity of the queues between them.
+struct PipelineOptions {
+    PipelineOptions();
+
+    ReadBackend readBackend = ReadBackend::Threads;
+    // Files each io_uring read thread keeps in flight.
+    unsigned readDepth = 64;
+    unsigned readThreads = 2;
+    unsigned decodeThreads = 1;
+    unsigned encodeThreads = 1;
+    unsigned writeThreads = 2;
+    size_t queueDepth = 8;
+};
+
+// Removes the pipeline options from args, leaving everything else behind.
+PipelineOptions ExtractPipelineOptions(std::deque<std::string> &args);
+
+struct BatchSummary {
+    size_t converted{};
+    size_t skipped{};
+    size_t failed{};
+    uintmax_t bytesRead{};
+    uintmax_t bytesWritten{};
+    double seconds{};
+};
+
+// Converts every job in a pipeline of overlapped read, decode, encode and write stages, with files read ahead of the
+// decoders and written behind the encoders. Errors are reported per job and do not stop the batch.
+//
+// With a previous manifest, jobs whose source contents and options are unchanged since it was written are skipped.
+// Every job that is converted or skipped then has its manifest entry in `result`.
+//
+// Sources with "ggpk:" paths are decoded in place from the archive, which is needed for them and for resolving
+// redirects inside it.
+BatchSummary RunBatch(std::vector<ConvertJob> &jobs, ConvertOptions const &options,
+                      PipelineOptions const &pipelineOptions, Manifest const *previous = nullptr,
+                      GgpkArchive const *archive = nullptr);
+
+// Converts a stream of DDS frames from `in` into a stream of PNG frames on `out`, in the same order. Each frame is a
+// little-endian 32-bit byte count followed by that many bytes. Every input frame gives one output frame per output
+// size, empty ones if it could not be converted, so that the two streams stay in step.
+BatchSummary RunStream(FILE *in, FILE *out, ConvertOptions const &options, PipelineOptions const &pipelineOptions,
+                       GgpkArchive const *archive = nullptr);
+
+void PrintBatchSummary(BatchSummary const &summary, size_t jobCount);
+
+#endif // BATCH_H
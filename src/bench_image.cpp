@@ -0,0 +1,507 @@
+// Throughput of the stages of a conversion, for comparing builds and machines. Every stage runs over a synthetic corpus
+// of random blocks and over the DDS files given on the command line, if any, and the results are written as JSON.
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include "cmp_core.h"
+#include "convert.h"
+#include "cpu_features.h"
+#include "dds.h"
+#include "decompress.h"
+#include "gli_format_names.h"
+#include "info.h"
+#include "lv_bptc.h"
+#include "payload.h"
+#include "thread_pool.h"
+
+namespace {
+struct Sample {
+    std::string name;
+    // The file as stored, and the DDS it unpacks to if it is compressed.
+    std::vector<uint8_t> file;
+    PixelBuffer unpacked;
+    DdsTexture tex;
+    // The base level decoded once up front, as the input of the PNG stage.
+    std::optional<Image> image;
+};
+
+struct Corpus {
+    std::string name;
+    std::vector<Sample> samples;
+};
+
+// Bytes going into a stage and blocks of the source texture they cover, uncompressed texels counting as 1x1 blocks.
+struct Work {
+    uint64_t bytes{};
+    uint64_t blocks{};
+};
+
+struct Summary {
+    double mean{}, stddev{}, min{}, max{};
+};
+
+struct Result {
+    std::string stage, corpus;
+    size_t samples{};
+    Work work;
+    Summary seconds, mbPerSecond, blocksPerSecond;
+};
+
+struct Stage {
+    char const *name;
+    bool (*accepts)(Sample const &sample);
+    Work (*run)(Sample const &sample);
+};
+
+struct BenchOptions {
+    int iterations = 5;
+    int size = 1024;
+    uint32_t seed = 1;
+    std::set<std::string> stages;
+    std::optional<std::string> outputPath;
+    std::optional<Isa> forceIsa;
+    unsigned threads = std::max(std::thread::hardware_concurrency(), 1u);
+};
+
+using DecompressBlockFunc = int (*)(unsigned char const *, unsigned char *, void const *);
+
+// Keeps the decoded pixels observable so that the work is not optimised away.
+volatile uint8_t sink;
+
+// Pool for the whole texture stages, with --threads threads, made once so that runs do not time thread start up.
+std::unique_ptr<ThreadPool> texturePool;
+
+bool IsFormat(Sample const &sample, std::initializer_list<gli::format> formats) {
+    return std::find(formats.begin(), formats.end(), sample.tex.format) != formats.end();
+}
+
+bool IsBc1(Sample const &sample) {
+    return IsFormat(sample, {gli::FORMAT_RGBA_DXT1_UNORM_BLOCK8, gli::FORMAT_RGBA_DXT1_SRGB_BLOCK8});
+}
+bool IsBc2(Sample const &sample) {
+    return IsFormat(sample, {gli::FORMAT_RGBA_DXT3_UNORM_BLOCK16, gli::FORMAT_RGBA_DXT3_SRGB_BLOCK16});
+}
+bool IsBc3(Sample const &sample) {
+    return IsFormat(sample, {gli::FORMAT_RGBA_DXT5_UNORM_BLOCK16, gli::FORMAT_RGBA_DXT5_SRGB_BLOCK16});
+}
+bool IsBc4(Sample const &sample) {
+    return IsFormat(sample, {gli::FORMAT_R_ATI1N_UNORM_BLOCK8, gli::FORMAT_R_ATI1N_SNORM_BLOCK8});
+}
+bool IsBc5(Sample const &sample) {
+    return IsFormat(sample, {gli::FORMAT_RG_ATI2N_UNORM_BLOCK16, gli::FORMAT_RG_ATI2N_SNORM_BLOCK16});
+}
+bool IsBc6(Sample const &sample) { return IsFormat(sample, {gli::FORMAT_RGB_BP_UFLOAT_BLOCK16}); }
+bool IsBc7(Sample const &sample) {
+    return IsFormat(sample, {gli::FORMAT_RGBA_BP_UNORM_BLOCK16, gli::FORMAT_RGBA_BP_SRGB_BLOCK16});
+}
+bool IsUncompressed(Sample const &sample) { return sample.tex.blockExtent == glm::ivec2(1); }
+bool HasImage(Sample const &sample) { return sample.image.has_value(); }
+
+template <DecompressBlockFunc Decompress> Work DecodeBlocks(Sample const &sample) {
+    auto data = sample.tex.LevelData(0, 0, 0);
+    size_t blockSize = sample.tex.blockSize;
+    uint8_t pixels[64];
+    uint8_t acc = 0;
+    for (size_t offset = 0; offset + blockSize <= data.size(); offset += blockSize) {
+        Decompress(data.data() + offset, pixels, nullptr);
+        acc ^= pixels[0];
+    }
+    sink = acc;
+    return {data.size(), data.size() / blockSize};
+}
+
+Work DecodeBlocksLvBptc(Sample const &sample) {
+    auto data = sample.tex.LevelData(0, 0, 0);
+    uint8_t pixels[64];
+    uint8_t acc = 0;
+    for (size_t offset = 0; offset + 16 <= data.size(); offset += 16) {
+        lv_bptc_decode_block_bc7(data.data() + offset, pixels);
+        acc ^= pixels[0];
+    }
+    sink = acc;
+    return {data.size(), data.size() / 16};
+}
+
+// The whole base level through DecompressTexture, into a buffer kept between runs.
+Work DecodeTexture(Sample const &sample) {
+    static std::vector<uint8_t> pixels;
+    auto &tex = sample.tex;
+    size_t pitch = size_t(tex.extent.x) * BlockDecoder(tex.format).PixelSize();
+    pixels.resize(pitch * tex.extent.y);
+    auto data = tex.LevelData(0, 0, 0);
+    DecompressTexture(tex.format, tex.extent.x, tex.extent.y, data, pixels.data(), pitch, *texturePool);
+    sink = pixels[0];
+    return {data.size(), data.size() / tex.blockSize};
+}
+
+uint64_t BlockCount(DdsTexture const &tex) {
+    glm::ivec2 blocks = (tex.extent + tex.blockExtent - 1) / tex.blockExtent;
+    return uint64_t(blocks.x) * blocks.y;
+}
+
+Work Swizzle(Sample const &sample) {
+    TextureDecoder decoder(sample.tex, {}, ConvertOptions{}, sample.name);
+    decoder.DecodeBlockRows(0, decoder.BlockRowCount());
+    sink = decoder.GetImage().data.data()[0];
+    return {sample.tex.LevelSize(0), BlockCount(sample.tex)};
+}
+
+// Halves the decoded image, as making icons from larger art does.
+Work ResampleHalf(Sample const &sample) {
+    auto const &img = *sample.image;
+    Image resized = Resample(img, FitExtent(img.extent, std::max(img.extent.x, img.extent.y) / 2),
+                             ResampleFilter::Lanczos3);
+    sink = resized.data.data()[0];
+    return {img.data.size(), BlockCount(sample.tex)};
+}
+
+Work WritePng(Sample const &sample) {
+    auto png = EncodePng(*sample.image);
+    sink = png.back();
+    return {sample.image->data.size(), BlockCount(sample.tex)};
+}
+
+// ConvertCommand without the file system: the stored file is unpacked, parsed, decoded and encoded to PNG.
+Work Convert(Sample const &sample) {
+    static PayloadResolver resolver(".");
+    ConvertOptions options;
+    PayloadScratch scratch;
+    LoadedTexture src = LoadTexture(resolver.Resolve(sample.file, scratch, sample.name), sample.name);
+    TextureDecoder decoder(src.tex, {}, options, sample.name);
+    decoder.DecodeBlockRows(0, decoder.BlockRowCount());
+    auto encoded = EncodeOutput(decoder.GetImage(), "bench.png", options, 0);
+    sink = encoded.png.back();
+    return {sample.file.size(), BlockCount(sample.tex)};
+}
+
+constexpr Stage Stages[] = {
+    {"lv_bptc.bc7", IsBc7, DecodeBlocksLvBptc},
+    {"cmp_core.bc1", IsBc1, DecodeBlocks<DecompressBlockBC1>},
+    {"cmp_core.bc2", IsBc2, DecodeBlocks<DecompressBlockBC2>},
+    {"cmp_core.bc3", IsBc3, DecodeBlocks<DecompressBlockBC3>},
+    {"cmp_core.bc7", IsBc7, DecodeBlocks<DecompressBlockBC7>},
+    {"texture.bc1", IsBc1, DecodeTexture},
+    {"texture.bc2", IsBc2, DecodeTexture},
+    {"texture.bc3", IsBc3, DecodeTexture},
+    {"texture.bc4", IsBc4, DecodeTexture},
+    {"texture.bc5", IsBc5, DecodeTexture},
+    {"texture.bc6h", IsBc6, DecodeTexture},
+    {"texture.bc7", IsBc7, DecodeTexture},
+    {"swizzle", IsUncompressed, Swizzle},
+    {"resample", HasImage, ResampleHalf},
+    {"png", HasImage, WritePng},
+    {"convert", HasImage, Convert},
+};
+
+// Parses the file, unpacking it first if it is compressed, and decodes the base level for the PNG stage if the format
+// is one that process-image converts.
+void Prepare(Sample &sample) {
+    gsl::span<uint8_t const> data = sample.file;
+    if (DetectPayload(data) == PayloadKind::Compressed) {
+        sample.unpacked = DecompressPayload(data, sample.name);
+        data = gsl::span<uint8_t const>(sample.unpacked.data(), sample.unpacked.size());
+    } else if (DetectPayload(data) == PayloadKind::Redirect) {
+        throw std::runtime_error(fmt::format("{} is a redirect", sample.name));
+    }
+    auto tex = ParseDds(data);
+    if (!tex) {
+        throw std::runtime_error(fmt::format("{} is not a DDS texture the native parser handles", sample.name));
+    }
+    sample.tex = *tex;
+    if (IsBc4(sample) || IsBc5(sample) || IsBc6(sample)) {
+        return;
+    }
+    TextureDecoder decoder(sample.tex, {}, ConvertOptions{}, sample.name);
+    decoder.DecodeBlockRows(0, decoder.BlockRowCount());
+    sample.image.emplace(std::move(decoder.GetImage()));
+}
+
+// Random blocks, with BC7 blocks spread evenly over the eight modes rather than weighted towards the lower ones as
+// random mode bits would be. Bytes and modes are the top bits of the generator's raw output, as the standard
+// distributions differ between standard libraries.
+Sample SyntheticSample(gli::format format, int size, std::mt19937 &rng) {
+    Sample ret;
+    ret.name = fmt::format("synthetic/{}", GliFormatName(format));
+    ret.file = WriteDdsHeader(format, glm::ivec2(size), 1);
+    auto header = ParseDdsHeader(ret.file);
+    size_t headerSize = ret.file.size();
+    ret.file.resize(headerSize + header->LevelSize(0));
+    for (size_t i = headerSize; i < ret.file.size(); ++i) {
+        ret.file[i] = uint8_t(rng() >> 24);
+    }
+    if (format == gli::FORMAT_RGBA_BP_UNORM_BLOCK16) {
+        for (size_t i = headerSize; i < ret.file.size(); i += 16) {
+            int m = int(rng() >> 29);
+            ret.file[i] = uint8_t((ret.file[i] & ~((2u << m) - 1)) | (1u << m));
+        }
+    }
+    Prepare(ret);
+    return ret;
+}
+
+Corpus SyntheticCorpus(BenchOptions const &options) {
+    std::mt19937 rng(options.seed);
+    Corpus ret{"synthetic", {}};
+    for (auto format : {gli::FORMAT_RGBA_DXT1_UNORM_BLOCK8, gli::FORMAT_RGBA_DXT3_UNORM_BLOCK16,
+                        gli::FORMAT_RGBA_DXT5_UNORM_BLOCK16, gli::FORMAT_R_ATI1N_UNORM_BLOCK8,
+                        gli::FORMAT_RG_ATI2N_UNORM_BLOCK16, gli::FORMAT_RGB_BP_UFLOAT_BLOCK16,
+                        gli::FORMAT_RGBA_BP_UNORM_BLOCK16, gli::FORMAT_BGRA8_UNORM_PACK8,
+                        gli::FORMAT_BGR8_UNORM_PACK32}) {
+        ret.samples.push_back(SyntheticSample(format, options.size, rng));
+    }
+    return ret;
+}
+
+// DDS files named directly or found below the given directories, in a stable order.
+Corpus SampleCorpus(std::deque<std::string> const &paths) {
+    namespace fs = std::filesystem;
+    std::vector<std::string> files;
+    for (auto &path : paths) {
+        if (fs::is_directory(path)) {
+            for (auto &entry : fs::recursive_directory_iterator(path)) {
+                auto ext = entry.path().extension().string();
+                std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char ch) { return std::tolower(ch); });
+                if (entry.is_regular_file() && ext == ".dds") {
+                    files.push_back(entry.path().string());
+                }
+            }
+        } else {
+            files.push_back(path);
+        }
+    }
+    std::sort(files.begin(), files.end());
+
+    Corpus ret{"samples", {}};
+    for (auto &file : files) {
+        Sample sample;
+        sample.name = file;
+        try {
+            sample.file = ReadFile(file);
+            Prepare(sample);
+            ret.samples.push_back(std::move(sample));
+        } catch (std::exception &e) {
+            fprintf(stderr, "warning: skipping %s: %s\n", file.c_str(), e.what());
+        }
+    }
+    return ret;
+}
+
+Summary Summarise(std::vector<double> const &values) {
+    Summary ret;
+    ret.min = *std::min_element(values.begin(), values.end());
+    ret.max = *std::max_element(values.begin(), values.end());
+    for (double v : values) {
+        ret.mean += v;
+    }
+    ret.mean /= values.size();
+    double var = 0.0;
+    for (double v : values) {
+        var += (v - ret.mean) * (v - ret.mean);
+    }
+    ret.stddev = values.size() > 1 ? std::sqrt(var / (values.size() - 1)) : 0.0;
+    return ret;
+}
+
+// One untimed pass to fault in memory and build lookup tables, then the timed ones.
+std::optional<Result> RunStage(Stage const &stage, Corpus const &corpus, int iterations) {
+    std::vector<Sample const *> samples;
+    for (auto &sample : corpus.samples) {
+        if (stage.accepts(sample)) {
+            samples.push_back(&sample);
+        }
+    }
+    if (samples.empty()) {
+        return {};
+    }
+
+    Result ret;
+    ret.stage = stage.name;
+    ret.corpus = corpus.name;
+    ret.samples = samples.size();
+    for (auto *sample : samples) {
+        Work work = stage.run(*sample);
+        ret.work.bytes += work.bytes;
+        ret.work.blocks += work.blocks;
+    }
+    std::vector<double> seconds, mbPerSecond, blocksPerSecond;
+    for (int i = 0; i < iterations; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        for (auto *sample : samples) {
+            stage.run(*sample);
+        }
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        elapsed = std::max(elapsed, 1e-9);
+        seconds.push_back(elapsed);
+        mbPerSecond.push_back(ret.work.bytes / 1e6 / elapsed);
+        blocksPerSecond.push_back(ret.work.blocks / elapsed);
+    }
+    ret.seconds = Summarise(seconds);
+    ret.mbPerSecond = Summarise(mbPerSecond);
+    ret.blocksPerSecond = Summarise(blocksPerSecond);
+    return ret;
+}
+
+std::string JsonSummary(Summary const &s) {
+    return fmt::format("{{\"mean\": {:.6g}, \"stddev\": {:.6g}, \"min\": {:.6g}, \"max\": {:.6g}}}", s.mean, s.stddev,
+                       s.min, s.max);
+}
+
+std::string Compiler() {
+#if defined(_MSC_VER) && !defined(__clang__)
+    return fmt::format("MSVC {}", _MSC_VER);
+#elif defined(__clang__)
+    return __VERSION__;
+#elif defined(__GNUC__)
+    return "GCC " __VERSION__;
+#else
+    return "unknown";
+#endif
+}
+
+std::string FormatResults(std::vector<Result> const &results, BenchOptions const &options) {
+#ifdef NDEBUG
+    bool optimised = true;
+#else
+    bool optimised = false;
+#endif
+    std::string ret = fmt::format("{{\n  \"compiler\": {},\n  \"ndebug\": {},\n  \"isa\": {},\n  \"iterations\": {},\n"
+                                  "  \"size\": {},\n  \"seed\": {},\n  \"threads\": {},\n  \"results\": [",
+                                  JsonString(Compiler()), optimised, JsonString(IsaName(ActiveIsa())),
+                                  options.iterations, options.size, options.seed, options.threads);
+    for (size_t i = 0; i < results.size(); ++i) {
+        auto &r = results[i];
+        ret += fmt::format("{}\n    {{\"stage\": {}, \"corpus\": {}, \"samples\": {}, \"bytes\": {}, \"blocks\": {},\n"
+                           "     \"seconds\": {},\n     \"mb_per_s\": {},\n     \"blocks_per_s\": {}}}",
+                           i ? "," : "", JsonString(r.stage), JsonString(r.corpus), r.samples, r.work.bytes,
+                           r.work.blocks, JsonSummary(r.seconds), JsonSummary(r.mbPerSecond),
+                           JsonSummary(r.blocksPerSecond));
+    }
+    return ret + "\n  ]\n}\n";
+}
+
+BenchOptions ExtractBenchOptions(std::deque<std::string> &args) {
+    BenchOptions ret;
+    for (auto I = args.begin(); I != args.end();) {
+        if (*I == "--iterations" || *I == "--size" || *I == "--seed" || *I == "--stages" || *I == "--output" ||
+            *I == "--force-isa" || *I == "--threads") {
+            if (I + 1 == args.end()) {
+                throw std::runtime_error(fmt::format("missing value for option {}", *I));
+            }
+            std::string const &value = *(I + 1);
+            if (*I == "--iterations") {
+                ret.iterations = IntoInt(value);
+                if (ret.iterations < 1) {
+                    throw std::runtime_error(fmt::format("invalid iteration count: {}", value));
+                }
+            } else if (*I == "--size") {
+                ret.size = IntoInt(value);
+                if (ret.size < 4 || ret.size > (1 << 14)) {
+                    throw std::runtime_error(fmt::format("invalid size: {}", value));
+                }
+            } else if (*I == "--seed") {
+                ret.seed = uint32_t(IntoInt(value));
+            } else if (*I == "--stages") {
+                for (size_t begin = 0; begin <= value.size();) {
+                    size_t end = std::min(value.find(',', begin), value.size());
+                    std::string name = value.substr(begin, end - begin);
+                    if (std::none_of(std::begin(Stages), std::end(Stages), [&](auto &s) { return name == s.name; })) {
+                        throw std::runtime_error(fmt::format("unknown stage: {}", name));
+                    }
+                    ret.stages.insert(name);
+                    begin = end + 1;
+                }
+            } else if (*I == "--force-isa") {
+                ret.forceIsa = ParseIsa(value);
+            } else if (*I == "--threads") {
+                int threads = IntoInt(value);
+                if (threads < 1) {
+                    throw std::runtime_error(fmt::format("invalid thread count: {}", value));
+                }
+                ret.threads = unsigned(threads);
+            } else {
+                ret.outputPath = value;
+            }
+            I = args.erase(I, I + 2);
+        } else {
+            ++I;
+        }
+    }
+    return ret;
+}
+} // namespace
+
+int main(int argc, char **argv) {
+    std::deque<std::string> args;
+    for (int i = 1; i < argc; ++i) {
+        args.push_back(argv[i]);
+    }
+
+    try {
+        BenchOptions options = ExtractBenchOptions(args);
+        if (std::any_of(args.begin(), args.end(), [](auto &arg) { return arg.rfind("--", 0) == 0; })) {
+            fprintf(stderr,
+                    "%s [--iterations N] [--size N] [--seed N] [--stages NAME,...] [--output PATH] [--force-isa LEVEL] "
+                    "[--threads N] [DDS_FILE|DIR...]\n",
+                    argv[0]);
+            fprintf(stderr, "stages:");
+            for (auto &stage : Stages) {
+                fprintf(stderr, " %s", stage.name);
+            }
+            fprintf(stderr, "\n");
+            return 1;
+        }
+        if (options.forceIsa) {
+            ForceIsa(*options.forceIsa);
+        }
+        texturePool = std::make_unique<ThreadPool>(options.threads);
+
+        std::vector<Corpus> corpora;
+        corpora.push_back(SyntheticCorpus(options));
+        if (!args.empty()) {
+            corpora.push_back(SampleCorpus(args));
+        }
+
+        std::vector<Result> results;
+        for (auto &corpus : corpora) {
+            for (auto &stage : Stages) {
+                if (!options.stages.empty() && !options.stages.count(stage.name)) {
+                    continue;
+                }
+                if (auto result = RunStage(stage, corpus, options.iterations)) {
+                    fprintf(stderr, "%-10s %-14s %9.1f MB/s +- %5.1f%%  %12.0f blocks/s\n", corpus.name.c_str(),
+                            stage.name, result->mbPerSecond.mean,
+                            100.0 * result->mbPerSecond.stddev / result->mbPerSecond.mean,
+                            result->blocksPerSecond.mean);
+                    results.push_back(std::move(*result));
+                }
+            }
+        }
+
+        std::string json = FormatResults(results, options);
+        if (options.outputPath) {
+            WriteFile(*options.outputPath, gsl::span<uint8_t const>(reinterpret_cast<uint8_t const *>(json.data()),
+                                                                     json.size()));
+        } else {
+            fwrite(json.data(), 1, json.size(), stdout);
+        }
+        return 0;
+    } catch (std::exception &e) {
+        fprintf(stderr, "error: %s\n", e.what());
+    }
+    return 1;
+}
@@ -0,0 +1,373 @@
+#include "compress.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <vector>
+#include <stdexcept>
+
+#include <fmt/core.h>
+
+#include "cmp_core.h"
+#include "gli_format_names.h"
+#include "thread_pool.h"
+
+// sRGB and linear variants get the same blocks, as they decode to the same bytes.
+BlockEncoder::BlockEncoder(gli::format format, float quality, uint8_t bc7Modes) {
+    switch (format) {
+    case gli::FORMAT_RGBA_DXT1_UNORM_BLOCK8:
+    case gli::FORMAT_RGBA_DXT1_SRGB_BLOCK8:
+        codec = Codec::Bc1;
+        CreateOptionsBC1(&options);
+        SetQualityBC1(options, quality);
+        break;
+    case gli::FORMAT_RGBA_DXT3_UNORM_BLOCK16:
+    case gli::FORMAT_RGBA_DXT3_SRGB_BLOCK16:
+        codec = Codec::Bc2;
+        CreateOptionsBC2(&options);
+        SetQualityBC2(options, quality);
+        break;
+    case gli::FORMAT_RGBA_DXT5_UNORM_BLOCK16:
+    case gli::FORMAT_RGBA_DXT5_SRGB_BLOCK16:
+        codec = Codec::Bc3;
+        CreateOptionsBC3(&options);
+        SetQualityBC3(options, quality);
+        break;
+    case gli::FORMAT_RGBA_BP_UNORM_BLOCK16:
+    case gli::FORMAT_RGBA_BP_SRGB_BLOCK16:
+        codec = Codec::Bc7;
+        CreateOptionsBC7(&options);
+        SetQualityBC7(options, quality);
+        SetMaskBC7(options, bc7Modes);
+        break;
+    default:
+        throw std::runtime_error(fmt::format("no block encoder for format {} ({})", GliFormatName(format), format));
+    }
+    blockSize = codec == Codec::Bc1 ? 8 : 16;
+}
+
+BlockEncoder::~BlockEncoder() {
+    switch (codec) {
+    case Codec::Bc1:
+        DestroyOptionsBC1(options);
+        break;
+    case Codec::Bc2:
+        DestroyOptionsBC2(options);
+        break;
+    case Codec::Bc3:
+        DestroyOptionsBC3(options);
+        break;
+    case Codec::Bc7:
+        DestroyOptionsBC7(options);
+        break;
+    }
+}
+
+void BlockEncoder::CompressBlock(uint8_t const *rgba, size_t pitch, uint8_t *dst) const {
+    switch (codec) {
+    case Codec::Bc1:
+        CompressBlockBC1(rgba, unsigned(pitch), dst, options);
+        break;
+    case Codec::Bc2:
+        CompressBlockBC2(rgba, unsigned(pitch), dst, options);
+        break;
+    case Codec::Bc3:
+        CompressBlockBC3(rgba, unsigned(pitch), dst, options);
+        break;
+    case Codec::Bc7:
+        CompressBlockBC7(rgba, unsigned(pitch), dst, options);
+        break;
+    }
+}
+
+namespace {
+// Compresses one row of blocks, starting at the top left texel of the row at `src`, of an image `width` texels wide
+// and with `rows` rows left from there. Edge blocks repeat the last row and column.
+void CompressBlockRow(BlockEncoder const &encoder, uint8_t const *src, size_t pitch, int width, int rows,
+                      uint8_t *dst) {
+    uint8_t edge[64];
+    for (int x = 0; x < width; x += 4, dst += encoder.BlockSize()) {
+        if (x + 4 <= width && rows >= 4) {
+            encoder.CompressBlock(src + x * 4, pitch, dst);
+            continue;
+        }
+        for (int i = 0; i < 16; ++i) {
+            int col = std::min(x + i % 4, width - 1), row = std::min(i / 4, rows - 1);
+            std::copy_n(src + row * pitch + col * 4, 4, edge + i * 4);
+        }
+        encoder.CompressBlock(edge, 16, dst);
+    }
+}
+} // namespace
+
+void CompressTexture(gli::format format, float quality, int width, int height, uint8_t const *src, size_t srcPitch,
+                     gsl::span<uint8_t> dst, ThreadPool &pool, CompressProgress const &progress) {
+    size_t blockSize = BlockEncoder(format, quality).BlockSize();
+    int blocksPerRow = (width + 3) / 4, blockRows = (height + 3) / 4;
+    size_t rowSize = size_t(blocksPerRow) * blockSize;
+    if (dst.size() < rowSize * blockRows) {
+        throw std::runtime_error(fmt::format("{} bytes for {} data, {}x{} needs {}", dst.size(), GliFormatName(format),
+                                             width, height, rowSize * blockRows));
+    }
+
+    // Single block rows, as even those take long enough at high quality for the bookkeeping not to matter.
+    std::atomic<int> nextRow{0};
+    auto compressRows = [&] {
+        BlockEncoder encoder(format, quality);
+        for (int blockY; (blockY = nextRow++) < blockRows;) {
+            CompressBlockRow(encoder, src + 4 * blockY * srcPitch, srcPitch, width, height - 4 * blockY,
+                             dst.data() + blockY * rowSize);
+            if (progress) {
+                progress(blocksPerRow);
+            }
+        }
+    };
+
+    TaskGroup group(pool);
+    unsigned tasks = std::min(pool.ThreadCount(), unsigned(std::max(blockRows, 1)));
+    for (unsigned i = 0; i < tasks; ++i) {
+        group.Run(compressRows);
+    }
+    group.Wait();
+}
+
+namespace {
+// Rows from `begin` up to `end`.
+struct RowRange {
+    int begin{}, end{};
+
+    bool Contains(int row) const { return row >= begin && row < end; }
+    int Size() const { return std::max(end - begin, 0); }
+};
+
+struct ChainLevel {
+    glm::ivec2 extent;
+    // Blocks of the level in the destination and the bytes of one row of them.
+    uint8_t *out;
+    size_t rowSize;
+    // To the next level, for all but the last.
+    std::optional<MipStep> down;
+};
+
+// The part of a pass down the chain that one task does, for the levels of the pass from the first on: the rows it
+// makes of each, and the rows it owns, which it compresses or, for the last level of a pass that does not reach the end
+// of the chain, stores for the next pass. Owned rows are whole block rows, split evenly between the tasks. Tasks make a
+// few rows either side of their own as well, so that they have all the taps for the rows they own further down.
+struct StripPlan {
+    std::vector<RowRange> make, own;
+};
+
+std::vector<StripPlan> PlanStrips(std::vector<ChainLevel> const &chain, int first, int last, unsigned strips) {
+    std::vector<StripPlan> ret(strips);
+    for (unsigned s = 0; s < strips; ++s) {
+        auto &plan = ret[s];
+        for (int level = first; level <= last && level < int(chain.size()); ++level) {
+            int height = chain[level].extent.y, blockRows = (height + 3) / 4;
+            int begin = int(int64_t(blockRows) * s / strips), end = int(int64_t(blockRows) * (s + 1) / strips);
+            plan.own.push_back({std::min(4 * begin, height), std::min(4 * end, height)});
+        }
+        plan.make = plan.own;
+        for (int i = int(plan.make.size()) - 2; i >= 0; --i) {
+            RowRange below = plan.make[i + 1];
+            if (below.Size() == 0) {
+                continue;
+            }
+            MipStep const &step = *chain[first + i].down;
+            RowRange taps{step.FirstRow(below.begin), step.FirstRow(below.end - 1) + step.Taps()};
+            RowRange &make = plan.make[i];
+            make = make.Size() == 0 ? taps : RowRange{std::min(make.begin, taps.begin), std::max(make.end, taps.end)};
+        }
+    }
+    return ret;
+}
+
+// Makes the rows of one strip of a pass from the top down, each level as the rows above it come in. A row is filtered
+// across for the level below as soon as it is made, into a ring holding as many rows as the step down has taps, and a
+// row of the level below is made as soon as the last of its taps is in the ring, so no level is ever held in full.
+class ChainStrip {
+  public:
+    ChainStrip(std::vector<ChainLevel> const &chain, int first, int last, StripPlan const &plan, bool srgb,
+               BlockEncoder const &encoder, CompressProgress const &progress)
+        : chain(chain), first(first), last(last), plan(plan), srgb(srgb), encoder(encoder), progress(progress),
+          levels(plan.make.size()) {
+        for (size_t i = 0; i < levels.size(); ++i) {
+            auto &level = levels[i];
+            int width = chain[first + i].extent.x;
+            level.linear.resize(4 * size_t(width));
+            if (first + int(i) > 0 && first + int(i) < last) {
+                level.texels.resize(16 * size_t(width));
+            }
+            if (i + 1 < levels.size()) {
+                MipStep const &step = *chain[first + i].down;
+                level.ringStride = 4 * size_t(step.Extent().x);
+                level.ring.resize(step.Taps() * level.ringStride);
+                level.taps.resize(step.Taps());
+            }
+            level.next = plan.make[i].begin;
+        }
+    }
+
+    // The first level comes from the source image for the first pass, or from the float rows stored by the pass before.
+    void Run(ImageRef const &src, float const *stored, float *store) {
+        storeOut = store;
+        image = &src;
+        int width = chain[first].extent.x;
+        for (int y = plan.make[0].begin; y < plan.make[0].end; ++y) {
+            float const *row = nullptr;
+            if (first > 0) {
+                row = stored + size_t(y) * 4 * width;
+            } else if (levels.size() > 1) {
+                ToLinearRgba(src.GetPixel({0, y}), width, srgb, levels[0].linear.data());
+                row = levels[0].linear.data();
+            }
+            Emit(first, y, row);
+        }
+    }
+
+  private:
+    struct Level {
+        std::vector<float> linear;
+        std::vector<uint8_t> texels;
+        // Rows of this level filtered across for the next, by row modulo the taps of the step down.
+        std::vector<float> ring;
+        size_t ringStride{};
+        // Rows of the ring for the row being made below, kept to not allocate them for each row.
+        std::vector<float const *> taps;
+        // Next row of this level to make from the level above.
+        int next{};
+    };
+
+    void Emit(int index, int y, float const *row) {
+        size_t i = index - first;
+        ChainLevel const &level = chain[index];
+        int width = level.extent.x, height = level.extent.y;
+        if (index == last) {
+            if (plan.own[i].Contains(y)) {
+                std::copy_n(row, 4 * size_t(width), storeOut + size_t(y) * 4 * width);
+            }
+            return;
+        }
+
+        if (plan.own[i].Contains(y)) {
+            // The first level of the chain is compressed from the image as it is, the others from their texels.
+            size_t pitch = 4 * size_t(width);
+            if (index > 0) {
+                FromLinearRgba(row, width, srgb, levels[i].texels.data() + (y % 4) * pitch);
+            }
+            if (y % 4 == 3 || y == height - 1) {
+                int blockY = y / 4, rows = y - 4 * blockY + 1;
+                if (index > 0) {
+                    CompressBlockRow(encoder, levels[i].texels.data(), pitch, width, rows,
+                                     level.out + blockY * level.rowSize);
+                } else {
+                    CompressBlockRow(encoder, image->GetPixel({0, 4 * blockY}), size_t(image->GetStride()), width,
+                                     rows, level.out + blockY * level.rowSize);
+                }
+                if (progress) {
+                    progress((width + 3) / 4);
+                }
+            }
+        }
+
+        if (i + 1 < levels.size()) {
+            MipStep const &step = *level.down;
+            Level &state = levels[i];
+            int taps = step.Taps();
+            step.FilterAcross(row, state.ring.data() + (y % taps) * state.ringStride);
+            RowRange const &make = plan.make[i + 1];
+            for (int &next = levels[i + 1].next; next < make.end && step.FirstRow(next) + taps - 1 <= y; ++next) {
+                for (int k = 0; k < taps; ++k) {
+                    state.taps[k] = state.ring.data() + ((step.FirstRow(next) + k) % taps) * state.ringStride;
+                }
+                step.FilterDown(next, state.taps.data(), levels[i + 1].linear.data());
+                Emit(index + 1, next, levels[i + 1].linear.data());
+            }
+        }
+    }
+
+    std::vector<ChainLevel> const &chain;
+    int first, last;
+    StripPlan const &plan;
+    bool srgb;
+    BlockEncoder const &encoder;
+    CompressProgress const &progress;
+    std::vector<Level> levels;
+    ImageRef const *image{};
+    float *storeOut{};
+};
+} // namespace
+
+void CompressMipChain(gli::format format, float quality, ImageRef const &src, int levels, ResampleFilter filter,
+                      bool srgb, gsl::span<uint8_t> dst, ThreadPool &pool, CompressProgress const &progress) {
+    if (src.components != 4) {
+        throw std::runtime_error(fmt::format("mip chains need RGBA images, not {} components", src.components));
+    }
+    size_t blockSize = BlockEncoder(format, quality).BlockSize();
+    std::vector<ChainLevel> chain;
+    size_t totalSize = 0;
+    for (int level = 0; level < levels; ++level) {
+        glm::ivec2 extent = glm::max(src.extent >> level, glm::ivec2(1));
+        size_t rowSize = size_t((extent.x + 3) / 4) * blockSize;
+        chain.push_back({extent, nullptr, rowSize, std::nullopt});
+        totalSize += rowSize * ((extent.y + 3) / 4);
+    }
+    if (dst.size() < totalSize) {
+        throw std::runtime_error(fmt::format("{} bytes for {} data, {}x{} with {} levels needs {}", dst.size(),
+                                             GliFormatName(format), src.extent.x, src.extent.y, levels, totalSize));
+    }
+    uint8_t *out = dst.data();
+    for (int level = 0; level < levels; ++level) {
+        chain[level].out = out;
+        out += chain[level].rowSize * ((chain[level].extent.y + 3) / 4);
+        if (level + 1 < levels) {
+            chain[level].down.emplace(chain[level].extent, glm::max(src.extent >> (level + 1), glm::ivec2(1)), filter);
+        }
+    }
+
+    // One encoder per task slot, kept across passes rather than made again for each.
+    unsigned slots = std::max(pool.ThreadCount(), 1u);
+    std::vector<std::unique_ptr<BlockEncoder>> encoders;
+    for (unsigned i = 0; i < slots; ++i) {
+        encoders.push_back(std::make_unique<BlockEncoder>(format, quality));
+    }
+
+    // Each pass splits the rows of its first level into strips, one task each, that go down as many levels as they can
+    // before the rows made twice at the edges of the strips, which double with every level, come to more than a
+    // quarter of the first level. The last level a pass reaches is stored as floats for the next one, by which time
+    // it is small. On one thread there is a single strip and a single pass.
+    PixelBuffer stored;
+    for (int first = 0; first < levels;) {
+        int height = chain[first].extent.y;
+        unsigned strips = std::min(slots, unsigned((height + 3) / 4));
+        int last = first + 1;
+        std::vector<StripPlan> plans = PlanStrips(chain, first, last, strips);
+        for (int candidate = last + 1; candidate <= levels; ++candidate) {
+            auto candidatePlans = PlanStrips(chain, first, candidate, strips);
+            int made = 0;
+            for (auto &plan : candidatePlans) {
+                made += plan.make[0].Size();
+            }
+            if (made > height + height / 4) {
+                break;
+            }
+            last = candidate;
+            plans = std::move(candidatePlans);
+        }
+
+        PixelBuffer store;
+        if (last < levels) {
+            store = PixelBuffer(size_t(chain[last].extent.x) * chain[last].extent.y * 4 * sizeof(float));
+        }
+        TaskGroup group(pool);
+        for (unsigned s = 0; s < strips; ++s) {
+            group.Run([&, s] {
+                ChainStrip strip(chain, first, last, plans[s], srgb, *encoders[s], progress);
+                strip.Run(src, reinterpret_cast<float const *>(stored.data()), reinterpret_cast<float *>(store.data()));
+            });
+        }
+        group.Wait();
+        stored = std::move(store);
+        first = last;
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+#include <gli/format.hpp>
+#include <gsl/span>
+
+#include "image.h"
+#include "resample.h"
+
+class ThreadPool;
+
+// Encodes RGBA8 blocks into BC1, BC2, BC3 or BC7 with CMP_Core at a quality from 0 to 1. BC7 can be limited to a set
+// of modes, bit n allowing mode n. The options are made once per encoder and only read while compressing.
+class BlockEncoder {
+  public:
+    BlockEncoder(gli::format format, float quality, uint8_t bc7Modes = 0xff);
+    ~BlockEncoder();
+
+    BlockEncoder(BlockEncoder const &) = delete;
+    BlockEncoder &operator=(BlockEncoder const &) = delete;
+
+    size_t BlockSize() const { return blockSize; }
+
+    // Compresses the 4x4 texels at `rgba`, whose rows are `pitch` bytes apart.
+    void CompressBlock(uint8_t const *rgba, size_t pitch, uint8_t *dst) const;
+
+  private:
+    enum class Codec { Bc1, Bc2, Bc3, Bc7 };
+
+    Codec codec{};
+    size_t blockSize{};
+    void *options{};
+};
+
+// Called from the compressing threads with the number of blocks in each band of block rows as it is finished.
+using CompressProgress = std::function<void(uint64_t blocks)>;
+
+// Compresses an RGBA8 image whose rows are `srcPitch` bytes apart into `dst`, which holds the blocks of one level of
+// `format`. Edge blocks of sizes that are not a multiple of four repeat the last row and column. Bands of block rows
+// are compressed on the pool and the calling thread, each thread keeping one encoder for all the bands it takes.
+void CompressTexture(gli::format format, float quality, int width, int height, uint8_t const *src, size_t srcPitch,
+                     gsl::span<uint8_t> dst, ThreadPool &pool, CompressProgress const &progress = {});
+
+// Compresses an RGBA8 image and the `levels` - 1 levels of a mip chain below it into `dst`, which holds the blocks of
+// each level of `format` one after the other, from the largest down. Each level is filtered from the one above it in
+// linear light with premultiplied alpha, taking the colour to be sRGB if `srgb` is set. Each task makes a strip of
+// every level from the rows above it as they come in, holding only as many rows of a level as the filter has taps.
+void CompressMipChain(gli::format format, float quality, ImageRef const &src, int levels, ResampleFilter filter,
+                      bool srgb, gsl::span<uint8_t> dst, ThreadPool &pool, CompressProgress const &progress = {});
+
+#endif // COMPRESS_H
@@ -0,0 +1,448 @@
+#include "convert.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <future>
+#include <memory>
+#include <stdexcept>
+
+#include <fmt/core.h>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+#include <gli/gli.hpp>
+#include <gli/load.hpp>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION 1
+#include <stb_image_write.h>
+
+#define STB_IMAGE_IMPLEMENTATION 1
+#define STBI_ONLY_PNG 1
+#include <stb_image.h>
+
+#include "gli_format_names.h"
+#include "hash.h"
+#include "probes.h"
+#include "stats.h"
+
+int IntoInt(std::string const &s) {
+    std::size_t pos{};
+    int ret = std::stoi(s, &pos, 10);
+    if (pos != s.size()) {
+        throw std::runtime_error("invalid integer");
+    }
+    return ret;
+}
+
+static glm::ivec2 IntoSize(std::string const &s) {
+    auto sep = s.find('x');
+    if (sep == std::string::npos) {
+        throw std::runtime_error(fmt::format("invalid size, expected WxH: {}", s));
+    }
+    return glm::ivec2(IntoInt(s.substr(0, sep)), IntoInt(s.substr(sep + 1)));
+}
+
+static std::vector<int> IntoIntList(std::string const &s) {
+    std::vector<int> ret;
+    std::size_t start = 0;
+    while (true) {
+        auto sep = s.find(',', start);
+        ret.push_back(IntoInt(s.substr(start, sep - start)));
+        if (sep == std::string::npos) {
+            return ret;
+        }
+        start = sep + 1;
+    }
+}
+
+ConvertOptions ExtractConvertOptions(std::deque<std::string> &args) {
+    ConvertOptions ret;
+    for (auto I = args.begin(); I != args.end();) {
+        if (*I == "--mip" || *I == "--max-size" || *I == "--sizes" || *I == "--filter" || *I == "--root" ||
+            *I == "--ggpk" || *I == "--stats" || *I == "--trace" || *I == "--force-isa") {
+            if (I + 1 == args.end()) {
+                throw std::runtime_error(fmt::format("missing value for option {}", *I));
+            }
+            if (*I == "--mip") {
+                ret.mipLevel = IntoInt(I[1]);
+            } else if (*I == "--max-size") {
+                ret.maxSize = IntoSize(I[1]);
+            } else if (*I == "--sizes") {
+                ret.sizes = IntoIntList(I[1]);
+            } else if (*I == "--root") {
+                ret.redirectRoot = I[1];
+            } else if (*I == "--ggpk") {
+                ret.ggpkPath = I[1];
+            } else if (*I == "--stats") {
+                ret.stats = ParseStatsFormat(I[1]);
+            } else if (*I == "--trace") {
+                ret.tracePath = I[1];
+            } else if (*I == "--force-isa") {
+                ret.forceIsa = ParseIsa(I[1]);
+            } else if (auto parsed = ParseResampleFilter(I[1])) {
+                ret.filter = *parsed;
+            } else {
+                throw std::runtime_error(fmt::format("unknown filter, expected lanczos or mitchell: {}", I[1]));
+            }
+            I = args.erase(I, I + 2);
+        } else {
+            ++I;
+        }
+    }
+
+    if (ret.mipLevel && ret.maxSize) {
+        throw std::runtime_error("--mip and --max-size are mutually exclusive");
+    }
+    if (std::any_of(ret.sizes.begin(), ret.sizes.end(), [](int size) { return size <= 0; })) {
+        throw std::runtime_error("output sizes must be positive");
+    }
+    return ret;
+}
+
+std::string ConvertOptionsKey(ConvertOptions const &options) {
+    std::string sizes;
+    for (int size : options.sizes) {
+        sizes += fmt::format("{},", size);
+    }
+    return fmt::format("mip={} max-size={}x{} sizes={} filter={}", options.mipLevel.value_or(-1),
+                       options.maxSize.value_or(glm::ivec2(0)).x, options.maxSize.value_or(glm::ivec2(0)).y, sizes,
+                       static_cast<int>(options.filter));
+}
+
+std::vector<uint8_t> ReadFile(std::string const &path) {
+    PhaseTimer timer(Phase::Read);
+    std::unique_ptr<FILE, decltype(&fclose)> fh(fopen(path.c_str(), "rb"), &fclose);
+    if (!fh) {
+        throw std::runtime_error(fmt::format("could not open file: {}", path));
+    }
+    return ReadStream(fh.get(), path);
+}
+
+std::vector<uint8_t> ReadStream(FILE *fh, std::string const &name) {
+    std::vector<uint8_t> ret;
+    uint8_t buf[1 << 16];
+    while (size_t n = fread(buf, 1, sizeof(buf), fh)) {
+        ret.insert(ret.end(), buf, buf + n);
+    }
+    if (ferror(fh)) {
+        throw std::runtime_error(fmt::format("could not read file: {}", name));
+    }
+    CountBytesRead(ret.size());
+    return ret;
+}
+
+FILE *BinaryStdin() {
+#ifdef _WIN32
+    _setmode(_fileno(stdin), _O_BINARY);
+#endif
+    return stdin;
+}
+
+FILE *BinaryStdout() {
+#ifdef _WIN32
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    return stdout;
+}
+
+void WriteFile(std::string const &path, gsl::span<uint8_t const> data) {
+    PhaseTimer timer(Phase::Write);
+    std::unique_ptr<FILE, decltype(&fclose)> fh(fopen(path.c_str(), "wb"), &fclose);
+    if (!fh || fwrite(data.data(), 1, data.size(), fh.get()) != data.size() || fflush(fh.get()) != 0) {
+        throw std::runtime_error(fmt::format("could not write file: {}", path));
+    }
+}
+
+// Maps a crop given in base level pixels onto a smaller mip level, widening it outward so that partially covered
+// texels at the edges are kept.
+static Rect CropAtLevel(Rect const &crop, int level, glm::ivec2 levelExtent) {
+    glm::ivec2 end = crop.origin + crop.size;
+    glm::ivec2 round((1 << level) - 1);
+    Rect ret;
+    ret.origin = glm::ivec2(crop.origin.x >> level, crop.origin.y >> level);
+    glm::ivec2 levelEnd = glm::min(glm::ivec2((end.x + round.x) >> level, (end.y + round.y) >> level), levelExtent);
+    ret.size = glm::max(levelEnd - ret.origin, glm::ivec2(1));
+    return ret;
+}
+
+LoadedTexture LoadTexture(gsl::span<uint8_t const> data, std::string const &name) {
+    PhaseTimer timer(Phase::Load);
+    int64_t probeStart = PROBE_START(load__end);
+    PROBE(load__start, name.c_str(), data.size());
+    LoadedTexture ret;
+    if (auto tex = ParseDds(data)) {
+        ret.tex = *tex;
+    } else {
+        ret.fallback = gli::load(reinterpret_cast<char const *>(data.data()), data.size());
+        if (ret.fallback.empty()) {
+            throw std::runtime_error(fmt::format("could not load texture: {}", name));
+        }
+        auto &fallback = ret.fallback;
+        ret.tex.format = fallback.format();
+        ret.tex.extent = glm::ivec2(fallback.extent(0));
+        ret.tex.levels = static_cast<int>(fallback.levels());
+        ret.tex.layers = static_cast<int>(fallback.layers());
+        ret.tex.faces = static_cast<int>(fallback.faces());
+        ret.tex.blockExtent = glm::ivec2(gli::block_extent(ret.tex.format));
+        ret.tex.blockSize = gli::block_size(ret.tex.format);
+        // gli stores layers, faces and levels in the same order as DDS files do.
+        ret.tex.data = gsl::make_span(fallback.data<uint8_t>(), fallback.size());
+    }
+    if (probeStart) {
+        PROBE(load__end, name.c_str(), int(ret.tex.format), ret.tex.extent.x, ret.tex.extent.y,
+              ProbeNowNs() - probeStart);
+    }
+    return ret;
+}
+
+TextureDecoder::TextureDecoder(DdsTexture const &tex, std::optional<Rect> cropOpt, ConvertOptions const &options,
+                               std::string const &name)
+    : srcTex(tex), name(name) {
+    auto fmt = srcTex.format;
+    extent = srcTex.extent;
+
+    if (gli::is_float(fmt)) {
+        throw std::runtime_error(fmt::format("floating point textures unsupported: {}", name));
+    }
+
+    if (srcTex.layers > 1 || srcTex.faces > 1) {
+        throw std::runtime_error(fmt::format("non-2D images unsupported: {}", name));
+    }
+
+    if (cropOpt) {
+        crop = *cropOpt;
+    } else {
+        crop.origin = glm::ivec2(0, 0);
+        crop.size = extent;
+    }
+
+    if (crop.size.x == 0 || crop.size.y == 0) {
+        throw std::runtime_error(fmt::format("crop specification is of zero size: x={}, y={}, width={}, height={}, {}",
+                                             crop.origin.x, crop.origin.y, crop.size.x, crop.size.y, name));
+    }
+
+    if (glm::ivec2 end = crop.origin + crop.size; end.x > extent.x || end.y > extent.y) {
+        throw std::runtime_error(
+            fmt::format("crop specification exceeds image size: x={}, y={}, width={}, height={}, {}", crop.origin.x,
+                        crop.origin.y, crop.size.x, crop.size.y, name));
+    }
+
+    // Pick the mip level to decode from, the crop above is always given in base level pixels.
+    int levelCount = srcTex.levels;
+    if (options.mipLevel) {
+        if (*options.mipLevel < 0 || *options.mipLevel >= levelCount) {
+            throw std::runtime_error(fmt::format("mip level {} out of range, texture has {} levels: {}",
+                                                 *options.mipLevel, levelCount, name));
+        }
+        level = *options.mipLevel;
+    } else if (auto maxSize = options.maxSize) {
+        if (maxSize->x <= 0 || maxSize->y <= 0) {
+            throw std::runtime_error(fmt::format("maximum size must be positive: {}x{}", maxSize->x, maxSize->y));
+        }
+        // Largest level whose cropped region fits within the requested size, or the smallest level if none does.
+        level = levelCount - 1;
+        for (int candidate = 0; candidate < levelCount; ++candidate) {
+            glm::ivec2 size = CropAtLevel(crop, candidate, srcTex.LevelExtent(candidate)).size;
+            if (size.x <= maxSize->x && size.y <= maxSize->y) {
+                level = candidate;
+                break;
+            }
+        }
+    } else if (!options.sizes.empty()) {
+        // Smallest level that still has at least as many pixels as the largest output size needs.
+        int largest = *std::max_element(options.sizes.begin(), options.sizes.end());
+        for (int candidate = levelCount - 1; candidate > 0; --candidate) {
+            glm::ivec2 size = CropAtLevel(crop, candidate, srcTex.LevelExtent(candidate)).size;
+            if (std::max(size.x, size.y) >= largest) {
+                level = candidate;
+                break;
+            }
+        }
+    }
+    if (level != 0) {
+        extent = srcTex.LevelExtent(level);
+        crop = CropAtLevel(crop, level, extent);
+    }
+
+    srcSpan = srcTex.LevelData(0, 0, level);
+
+    // sRGB and linear variants decode to the same bytes, no conversion is done either way.
+    if (gli::is_compressed(fmt)) {
+        switch (fmt) {
+        case gli::FORMAT_RGBA_BP_UNORM_BLOCK16:
+        case gli::FORMAT_RGBA_BP_SRGB_BLOCK16:
+        case gli::FORMAT_RGBA_DXT1_UNORM_BLOCK8:
+        case gli::FORMAT_RGBA_DXT1_SRGB_BLOCK8:
+        case gli::FORMAT_RGBA_DXT3_UNORM_BLOCK16:
+        case gli::FORMAT_RGBA_DXT3_SRGB_BLOCK16:
+        case gli::FORMAT_RGBA_DXT5_UNORM_BLOCK16:
+        case gli::FORMAT_RGBA_DXT5_SRGB_BLOCK16:
+            break;
+        default:
+            throw std::runtime_error(fmt::format("unhandled format {} ({}): {}", GliFormatName(fmt), fmt, name));
+        }
+
+        compressed = true;
+        blockSize = srcTex.blockSize;
+        blockExtent = srcTex.blockExtent;
+        blockCount = (extent + glm::ivec2(blockExtent - 1)) / glm::ivec2(blockExtent);
+        dstImg = Image(crop.size, 4);
+    } else {
+        glm::ivec2 srcExtent = extent;
+        glm::vec<4, MapTo> compRemap{MapTo::Red, MapTo::Green, MapTo::Blue, MapTo::Alpha};
+        switch (fmt) {
+        case gli::FORMAT_BGR8_UNORM_PACK32:
+        case gli::FORMAT_BGR8_SRGB_PACK32: {
+            compRemap = {MapTo::Blue, MapTo::Green, MapTo::Red, MapTo::One};
+            srcImg = ImageRef(srcExtent, 4, srcSpan);
+            dstImg = Image(crop.size, 3);
+        } break;
+        case gli::FORMAT_BGRA8_UNORM_PACK8:
+        case gli::FORMAT_BGRA8_SRGB_PACK8: {
+            compRemap = {MapTo::Blue, MapTo::Green, MapTo::Red, MapTo::Alpha};
+            srcImg = ImageRef(srcExtent, 4, srcSpan);
+            dstImg = Image(crop.size, 4);
+        } break;
+        // case gli::FORMAT_R16_SFLOAT_PACK16: {} break;
+        // case gli::FORMAT_R32_SFLOAT_PACK32: {} break;
+        // case gli::FORMAT_RG16_SFLOAT_PACK16: {} break;
+        case gli::FORMAT_RG8_UNORM_PACK8: {
+            compRemap = {MapTo::Red, MapTo::Green, MapTo::Zero, MapTo::One};
+            srcImg = ImageRef(srcExtent, 2, srcSpan);
+            dstImg = Image(crop.size, 3);
+        } break;
+        // case gli::FORMAT_RGBA32_SFLOAT_PACK32: {} break;
+        case gli::FORMAT_RGBA8_SRGB_PACK8:
+        case gli::FORMAT_RGBA8_UNORM_PACK8: {
+            srcImg = ImageRef(srcExtent, 4, srcSpan);
+            dstImg = Image(crop.size, 4);
+        } break;
+        default:
+            throw std::runtime_error(fmt::format("unhandled format {} ({}): {}", GliFormatName(fmt), fmt, name));
+        }
+
+        swizzle.srcComps = srcImg->components;
+        swizzle.dstComps = dstImg->components;
+        for (int comp = 0; comp < 4; ++comp) {
+            MapTo remap = compRemap[comp];
+            swizzle.map[comp] = remap == MapTo::One    ? SwizzleOne
+                                : remap == MapTo::Zero ? SwizzleZero
+                                                       : static_cast<int8_t>(remap);
+        }
+        swizzleRow = GetSwizzleRowFunc();
+    }
+
+    firstBlock = crop.origin / blockExtent;
+    lastBlock = (crop.origin + crop.size + blockExtent - 1) / blockExtent;
+}
+
+void TextureDecoder::DecodeBlockRows(int begin, int end) {
+    PhaseTimer timer(compressed ? Phase::Decode : Phase::Remap);
+    BlockTimer blocks(srcTex.format, uint64_t(end - begin) * BlocksPerRow());
+    int64_t probeStart = PROBE_START(decode__band);
+    if (compressed) {
+        // Bands decoded concurrently each have their own decoder.
+        BlockDecoder decoder(srcTex.format);
+        for (int blockRow = begin; blockRow < end; ++blockRow) {
+            DecodeCompressed(decoder, firstBlock.y + blockRow);
+        }
+    } else {
+        for (int blockRow = begin; blockRow < end; ++blockRow) {
+            DecodeUncompressed(blockRow);
+        }
+    }
+    if (probeStart) {
+        PROBE(decode__band, name.c_str(), int(srcTex.format), begin, end, ProbeNowNs() - probeStart);
+    }
+}
+
+// Decodes the blocks in this row that cover the crop, straight into the rows of the image that they cover.
+void TextureDecoder::DecodeCompressed(BlockDecoder const &decoder, int blockY) {
+    int top = blockY * blockExtent.y;
+    int firstRow = std::max(crop.origin.y - top, 0);
+    int endRow = std::min(crop.origin.y + crop.size.y - top, blockExtent.y);
+    auto blocks = srcSpan.subspan(size_t(blockY) * blockCount.x * blockSize, size_t(blockCount.x) * blockSize);
+    decoder.DecodeRow(blocks.data(), crop.origin.x, crop.size.x, firstRow, endRow - firstRow,
+                      dstImg->GetPixel({0, top + firstRow - crop.origin.y}), size_t(dstImg->extent.x) * 4);
+}
+
+void TextureDecoder::DecodeUncompressed(int row) {
+    swizzleRow(srcImg->GetPixel(crop.origin + glm::ivec2(0, row)), dstImg->GetPixel({0, row}), dstImg->extent.x,
+               swizzle);
+}
+
+std::string SizedPath(std::string const &path, int size) {
+    return fmt::format("{}_{}.png", path.substr(0, path.size() - 4), size);
+}
+
+std::vector<std::string> OutputPaths(std::string const &dstPath, ConvertOptions const &options) {
+    if (options.sizes.empty()) {
+        return {dstPath};
+    }
+    std::vector<std::string> ret;
+    for (int size : options.sizes) {
+        ret.push_back(SizedPath(dstPath, size));
+    }
+    return ret;
+}
+
+std::vector<uint8_t> EncodePng(ImageRef const &img) {
+    PhaseTimer timer(Phase::Encode);
+    int64_t probeStart = PROBE_START(png__encode);
+    int len{};
+    std::unique_ptr<unsigned char, decltype(&free)> png(
+        stbi_write_png_to_mem(img.GetPixel({0, 0}), img.GetStride(), img.extent.x, img.extent.y, img.components, &len),
+        &free);
+    if (!png) {
+        throw std::runtime_error("could not encode PNG");
+    }
+    CountPng(len);
+    if (probeStart) {
+        PROBE(png__encode, img.extent.x, img.extent.y, img.components, len, ProbeNowNs() - probeStart);
+    }
+    return std::vector<uint8_t>(png.get(), png.get() + len);
+}
+
+Image DecodePng(gsl::span<uint8_t const> data, std::string const &name) {
+    int width{}, height{}, comps{};
+    std::unique_ptr<stbi_uc, decltype(&stbi_image_free)> pixels(
+        stbi_load_from_memory(data.data(), int(data.size()), &width, &height, &comps, 4), &stbi_image_free);
+    if (!pixels) {
+        throw std::runtime_error(fmt::format("could not decode PNG: {}: {}", stbi_failure_reason(), name));
+    }
+    Image ret(glm::ivec2(width, height), 4);
+    memcpy(ret.data.data(), pixels.get(), ret.data.size());
+    return ret;
+}
+
+EncodedOutput EncodeOutput(Image const &img, std::string const &dstPath, ConvertOptions const &options, size_t index) {
+    // At this point, we have R 8, RG 8.8, RGB 8.8.8 or RGBA 8.8.8.8 unsigned integer texture data
+    if (options.sizes.empty()) {
+        return {dstPath, EncodePng(img)};
+    }
+    int size = options.sizes[index];
+    Image resized = Resample(img, FitExtent(img.extent, size), options.filter);
+    return {SizedPath(dstPath, size), EncodePng(resized)};
+}
+
+std::vector<OutputFile> WriteOutputs(Image const &img, std::string const &dstPath, ConvertOptions const &options) {
+    // Every requested size is resampled and encoded from the one decoded image in parallel.
+    size_t count = std::max<size_t>(options.sizes.size(), 1);
+    std::vector<std::future<OutputFile>> outputs;
+    for (size_t i = 0; i < count; ++i) {
+        outputs.push_back(std::async(count > 1 ? std::launch::async : std::launch::deferred, [&, i] {
+            auto encoded = EncodeOutput(img, dstPath, options, i);
+            WriteFile(encoded.path, encoded.png);
+            return OutputFile{encoded.path, encoded.png.size(), HashBytes(encoded.png.data(), encoded.png.size())};
+        }));
+    }
+    std::vector<OutputFile> ret;
+    for (auto &output : outputs) {
+        ret.push_back(output.get());
+    }
+    return ret;
+}
@@ -0,0 +1,140 @@
+#ifndef CONVERT_H
+#define CONVERT_H
+
+#include <cstdio>
+#include <deque>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <gli/texture.hpp>
+
+#include "cpu_features.h"
+#include "dds.h"
+#include "decompress.h"
+#include "image.h"
+#include "resample.h"
+#include "stats.h"
+#include "swizzle.h"
+
+struct ConvertOptions {
+    std::optional<int> mipLevel;
+    std::optional<glm::ivec2> maxSize;
+    std::vector<int> sizes;
+    ResampleFilter filter = ResampleFilter::Lanczos3;
+    // Directory that the game relative paths of redirect stubs are looked up in.
+    std::optional<std::string> redirectRoot;
+    // Content.ggpk that "ggpk:" source paths and redirects are read from.
+    std::optional<std::string> ggpkPath;
+    // Collect timings and counters, printed in this format when the command is done.
+    std::optional<StatsFormat> stats;
+    // Chrome trace events of what each thread did are written here when the command is done.
+    std::optional<std::string> tracePath;
+    // Instruction set level to limit the kernels to, rather than the best the CPU supports.
+    std::optional<Isa> forceIsa;
+};
+
+int IntoInt(std::string const &s);
+
+// Removes the conversion options from args, leaving only the positional arguments behind.
+ConvertOptions ExtractConvertOptions(std::deque<std::string> &args);
+
+// Canonical description of the options that affect the output, for detecting changed settings between runs.
+std::string ConvertOptionsKey(ConvertOptions const &options);
+
+std::vector<uint8_t> ReadFile(std::string const &path);
+void WriteFile(std::string const &path, gsl::span<uint8_t const> data);
+
+// Reads up to the end of an already open stream, the name is for errors.
+std::vector<uint8_t> ReadStream(FILE *fh, std::string const &name);
+
+// Standard input and output, switched to binary mode on platforms that would otherwise translate line endings.
+FILE *BinaryStdin();
+FILE *BinaryStdout();
+
+// A texture described in place over a file buffer, or loaded by gli when the native parser does not handle the file.
+// In the latter case the pixel data lives in `fallback` rather than in the buffer.
+struct LoadedTexture {
+    DdsTexture tex;
+    gli::texture fallback;
+};
+
+// The buffer must outlive the result, which does not own the pixel data unless gli had to load it.
+LoadedTexture LoadTexture(gsl::span<uint8_t const> data, std::string const &name);
+
+// Decodes a region of one mip level of a 2D texture to 8-bit pixels. The region is given in base level pixels and
+// the level is picked from the options. Decoding is split into rows of blocks, and disjoint ranges of rows may be
+// decoded concurrently.
+class TextureDecoder {
+  public:
+    // The texture's data must outlive the decoder.
+    TextureDecoder(DdsTexture const &tex, std::optional<Rect> crop, ConvertOptions const &options,
+                   std::string const &name);
+
+    int BlockRowCount() const { return lastBlock.y - firstBlock.y; }
+    int BlocksPerRow() const { return lastBlock.x - firstBlock.x; }
+    void DecodeBlockRows(int begin, int end);
+
+    Image &GetImage() { return *dstImg; }
+
+  private:
+    enum class MapTo {
+        Red = 0,
+        Green = 1,
+        Blue = 2,
+        Alpha = 3,
+        One,
+        Zero,
+    };
+    void DecodeCompressed(BlockDecoder const &decoder, int blockY);
+    void DecodeUncompressed(int row);
+
+    DdsTexture srcTex;
+    std::string name;
+    int level{};
+    glm::ivec2 extent{};
+    Rect crop{};
+    gsl::span<uint8_t const> srcSpan;
+    glm::ivec2 blockExtent{1, 1};
+    glm::ivec2 firstBlock{}, lastBlock{};
+
+    bool compressed{};
+    size_t blockSize{};
+    glm::ivec2 blockCount{};
+
+    Swizzle swizzle;
+    SwizzleRowFunc swizzleRow{};
+    std::optional<ImageRef> srcImg;
+
+    std::optional<Image> dstImg;
+};
+
+// Output path for one of several sizes, "icon.png" becomes "icon_64.png".
+std::string SizedPath(std::string const &path, int size);
+
+// The files that WriteOutputs produces for dstPath.
+std::vector<std::string> OutputPaths(std::string const &dstPath, ConvertOptions const &options);
+
+std::vector<uint8_t> EncodePng(ImageRef const &img);
+
+// Decodes a PNG of any colour type to RGBA8.
+Image DecodePng(gsl::span<uint8_t const> data, std::string const &name);
+
+struct EncodedOutput {
+    std::string path;
+    std::vector<uint8_t> png;
+};
+
+// Encodes entry `index` of OutputPaths: the image itself, or the copy resampled to options.sizes[index].
+EncodedOutput EncodeOutput(Image const &img, std::string const &dstPath, ConvertOptions const &options, size_t index);
+
+struct OutputFile {
+    std::string path;
+    uint64_t size{};
+    uint64_t hash{};
+};
+
+// Writes the decoded image to dstPath, or resampled copies of it to one path per size if sizes were requested.
+std::vector<OutputFile> WriteOutputs(Image const &img, std::string const &dstPath, ConvertOptions const &options);
+
+#endif // CONVERT_H
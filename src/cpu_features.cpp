@@ -0,0 +1,108 @@
+#include "cpu_features.h"
+
+#include <atomic>
+#include <iterator>
+#include <stdexcept>
+
+#include <fmt/core.h>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <immintrin.h>
+#include <intrin.h>
+#define PROCESS_IMAGE_CPUID 1
+#endif
+
+namespace {
+constexpr char const *IsaNames[] = {"scalar", "sse2", "ssse3", "sse4.1", "avx2", "avx512"};
+
+#ifdef PROCESS_IMAGE_CPUID
+Isa Detect() {
+    int regs[4];
+    __cpuid(regs, 0);
+    int maxLeaf = regs[0];
+    __cpuid(regs, 1);
+    int ecx = regs[2], edx = regs[3];
+    if (!(edx & (1 << 26))) {
+        return Isa::Scalar;
+    }
+    if (!(ecx & (1 << 9))) {
+        return Isa::Sse2;
+    }
+    if (!(ecx & (1 << 19))) {
+        return Isa::Ssse3;
+    }
+    // The wider registers are only usable when the operating system saves them on context switches.
+    bool fma = ecx & (1 << 12), osxsave = ecx & (1 << 27);
+    if (maxLeaf < 7 || !fma || !osxsave) {
+        return Isa::Sse41;
+    }
+    unsigned long long xcr0 = _xgetbv(0);
+    __cpuidex(regs, 7, 0);
+    int ebx = regs[1];
+    if ((xcr0 & 0x6) != 0x6 || !(ebx & (1 << 5))) {
+        return Isa::Sse41;
+    }
+    bool avx512 = (ebx & (1 << 16)) && (ebx & (1 << 30)) && (ebx & (1u << 31));
+    if ((xcr0 & 0xe6) != 0xe6 || !avx512) {
+        return Isa::Avx2;
+    }
+    return Isa::Avx512;
+}
+#elif defined(__x86_64__) || defined(__i386__)
+Isa Detect() {
+    // GCC and Clang also check that the operating system saves the registers.
+    __builtin_cpu_init();
+    if (!__builtin_cpu_supports("sse2")) {
+        return Isa::Scalar;
+    }
+    if (!__builtin_cpu_supports("ssse3")) {
+        return Isa::Sse2;
+    }
+    if (!__builtin_cpu_supports("sse4.1")) {
+        return Isa::Ssse3;
+    }
+    if (!__builtin_cpu_supports("avx2") || !__builtin_cpu_supports("fma")) {
+        return Isa::Sse41;
+    }
+    if (!__builtin_cpu_supports("avx512f") || !__builtin_cpu_supports("avx512bw") ||
+        !__builtin_cpu_supports("avx512vl")) {
+        return Isa::Avx2;
+    }
+    return Isa::Avx512;
+}
+#else
+Isa Detect() { return Isa::Scalar; }
+#endif
+
+std::atomic<int> forcedIsa{-1};
+} // namespace
+
+Isa ParseIsa(std::string_view name) {
+    for (size_t i = 0; i < std::size(IsaNames); ++i) {
+        if (name == IsaNames[i]) {
+            return static_cast<Isa>(i);
+        }
+    }
+    throw std::runtime_error(
+        fmt::format("unknown instruction set, expected scalar, sse2, ssse3, sse4.1, avx2 or avx512: {}", name));
+}
+
+char const *IsaName(Isa isa) { return IsaNames[static_cast<int>(isa)]; }
+
+Isa DetectedIsa() {
+    static Isa const detected = Detect();
+    return detected;
+}
+
+Isa ActiveIsa() {
+    int forced = forcedIsa.load(std::memory_order_relaxed);
+    return forced < 0 ? DetectedIsa() : static_cast<Isa>(forced);
+}
+
+void ForceIsa(Isa isa) {
+    if (isa > DetectedIsa()) {
+        throw std::runtime_error(
+            fmt::format("this CPU does not support {}, the highest level is {}", IsaName(isa), IsaName(DetectedIsa())));
+    }
+    forcedIsa = static_cast<int>(isa);
+}
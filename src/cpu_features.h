@@ -0,0 +1,33 @@
+#ifndef CPU_FEATURES_H
+#define CPU_FEATURES_H
+
+#include <string_view>
+
+// Instruction set levels that kernels are built for, each implying the ones before it. A kernel family picks its
+// best variant at or below the active level the first time it is used and keeps it for the rest of the process.
+enum class Isa {
+    Scalar,
+    Sse2,
+    Ssse3,
+    Sse41,
+    // AVX2 with FMA.
+    Avx2,
+    // AVX-512 F, BW and VL.
+    Avx512,
+};
+
+// Parses "scalar", "sse2", "ssse3", "sse4.1", "avx2" or "avx512".
+Isa ParseIsa(std::string_view name);
+char const *IsaName(Isa isa);
+
+// Highest level that both the CPU and the operating system support.
+Isa DetectedIsa();
+
+// Level that kernels are picked for, the detected one unless lowered by ForceIsa.
+Isa ActiveIsa();
+
+// Limits kernels to a lower level, for comparing the variants on one machine. Must be called before any kernel is
+// used, and fails if the CPU does not support the level.
+void ForceIsa(Isa isa);
+
+#endif // CPU_FEATURES_H
@@ -0,0 +1,370 @@
+#include "dds.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include <fmt/core.h>
+
+namespace {
+constexpr uint32_t FourCC(char a, char b, char c, char d) {
+    return uint32_t(uint8_t(a)) | uint32_t(uint8_t(b)) << 8 | uint32_t(uint8_t(c)) << 16 | uint32_t(uint8_t(d)) << 24;
+}
+
+constexpr uint32_t DDSD_CAPS = 0x1;
+constexpr uint32_t DDSD_HEIGHT = 0x2;
+constexpr uint32_t DDSD_WIDTH = 0x4;
+constexpr uint32_t DDSD_PITCH = 0x8;
+constexpr uint32_t DDSD_PIXELFORMAT = 0x1000;
+constexpr uint32_t DDSD_MIPMAPCOUNT = 0x20000;
+constexpr uint32_t DDSD_LINEARSIZE = 0x80000;
+constexpr uint32_t DDSCAPS_COMPLEX = 0x8;
+constexpr uint32_t DDSCAPS_TEXTURE = 0x1000;
+constexpr uint32_t DDSCAPS_MIPMAP = 0x400000;
+constexpr uint32_t DDPF_ALPHAPIXELS = 0x1;
+constexpr uint32_t DDPF_FOURCC = 0x4;
+constexpr uint32_t DDPF_RGB = 0x40;
+constexpr uint32_t DDPF_LUMINANCE = 0x20000;
+constexpr uint32_t DDSCAPS2_CUBEMAP = 0x200;
+constexpr uint32_t DDSCAPS2_VOLUME = 0x200000;
+constexpr uint32_t DDS_RESOURCE_MISC_TEXTURECUBE = 0x4;
+constexpr uint32_t DDS_DIMENSION_TEXTURE2D = 3;
+constexpr uint32_t DDS_DIMENSION_TEXTURE3D = 4;
+
+struct FormatInfo {
+    gli::format format;
+    int blockDim;
+    size_t blockSize;
+};
+
+// Bytes per 4x4 block for the block compressed formats, bytes per texel for the rest.
+FormatInfo Info(gli::format format) {
+    switch (format) {
+    case gli::FORMAT_RGBA_DXT1_UNORM_BLOCK8:
+    case gli::FORMAT_RGBA_DXT1_SRGB_BLOCK8:
+    case gli::FORMAT_R_ATI1N_UNORM_BLOCK8:
+    case gli::FORMAT_R_ATI1N_SNORM_BLOCK8:
+        return {format, 4, 8};
+    case gli::FORMAT_RGBA_DXT3_UNORM_BLOCK16:
+    case gli::FORMAT_RGBA_DXT3_SRGB_BLOCK16:
+    case gli::FORMAT_RGBA_DXT5_UNORM_BLOCK16:
+    case gli::FORMAT_RGBA_DXT5_SRGB_BLOCK16:
+    case gli::FORMAT_RG_ATI2N_UNORM_BLOCK16:
+    case gli::FORMAT_RG_ATI2N_SNORM_BLOCK16:
+    case gli::FORMAT_RGB_BP_UFLOAT_BLOCK16:
+    case gli::FORMAT_RGB_BP_SFLOAT_BLOCK16:
+    case gli::FORMAT_RGBA_BP_UNORM_BLOCK16:
+    case gli::FORMAT_RGBA_BP_SRGB_BLOCK16:
+        return {format, 4, 16};
+    case gli::FORMAT_R8_UNORM_PACK8:
+    case gli::FORMAT_L8_UNORM_PACK8:
+    case gli::FORMAT_A8_UNORM_PACK8:
+        return {format, 1, 1};
+    case gli::FORMAT_RG8_UNORM_PACK8:
+    case gli::FORMAT_LA8_UNORM_PACK8:
+    case gli::FORMAT_R16_UNORM_PACK16:
+    case gli::FORMAT_R16_SFLOAT_PACK16:
+        return {format, 1, 2};
+    case gli::FORMAT_RGBA8_UNORM_PACK8:
+    case gli::FORMAT_RGBA8_SRGB_PACK8:
+    case gli::FORMAT_BGRA8_UNORM_PACK8:
+    case gli::FORMAT_BGRA8_SRGB_PACK8:
+    case gli::FORMAT_BGR8_UNORM_PACK32:
+    case gli::FORMAT_BGR8_SRGB_PACK32:
+    case gli::FORMAT_RG16_UNORM_PACK16:
+    case gli::FORMAT_RG16_SFLOAT_PACK16:
+    case gli::FORMAT_R32_SFLOAT_PACK32:
+        return {format, 1, 4};
+    case gli::FORMAT_RGBA16_UNORM_PACK16:
+    case gli::FORMAT_RGBA16_SFLOAT_PACK16:
+    case gli::FORMAT_RG32_SFLOAT_PACK32:
+        return {format, 1, 8};
+    case gli::FORMAT_RGBA32_SFLOAT_PACK32:
+        return {format, 1, 16};
+    default:
+        return {gli::FORMAT_UNDEFINED, 0, 0};
+    }
+}
+
+struct FormatCode {
+    uint32_t code;
+    gli::format format;
+};
+
+constexpr FormatCode DxgiFormats[] = {
+    {2, gli::FORMAT_RGBA32_SFLOAT_PACK32},
+    {10, gli::FORMAT_RGBA16_SFLOAT_PACK16},
+    {11, gli::FORMAT_RGBA16_UNORM_PACK16},
+    {16, gli::FORMAT_RG32_SFLOAT_PACK32},
+    {28, gli::FORMAT_RGBA8_UNORM_PACK8},
+    {29, gli::FORMAT_RGBA8_SRGB_PACK8},
+    {34, gli::FORMAT_RG16_SFLOAT_PACK16},
+    {35, gli::FORMAT_RG16_UNORM_PACK16},
+    {41, gli::FORMAT_R32_SFLOAT_PACK32},
+    {49, gli::FORMAT_RG8_UNORM_PACK8},
+    {54, gli::FORMAT_R16_SFLOAT_PACK16},
+    {56, gli::FORMAT_R16_UNORM_PACK16},
+    {61, gli::FORMAT_R8_UNORM_PACK8},
+    {65, gli::FORMAT_A8_UNORM_PACK8},
+    {71, gli::FORMAT_RGBA_DXT1_UNORM_BLOCK8},
+    {72, gli::FORMAT_RGBA_DXT1_SRGB_BLOCK8},
+    {74, gli::FORMAT_RGBA_DXT3_UNORM_BLOCK16},
+    {75, gli::FORMAT_RGBA_DXT3_SRGB_BLOCK16},
+    {77, gli::FORMAT_RGBA_DXT5_UNORM_BLOCK16},
+    {78, gli::FORMAT_RGBA_DXT5_SRGB_BLOCK16},
+    {80, gli::FORMAT_R_ATI1N_UNORM_BLOCK8},
+    {81, gli::FORMAT_R_ATI1N_SNORM_BLOCK8},
+    {83, gli::FORMAT_RG_ATI2N_UNORM_BLOCK16},
+    {84, gli::FORMAT_RG_ATI2N_SNORM_BLOCK16},
+    {87, gli::FORMAT_BGRA8_UNORM_PACK8},
+    {88, gli::FORMAT_BGR8_UNORM_PACK32},
+    {91, gli::FORMAT_BGRA8_SRGB_PACK8},
+    {93, gli::FORMAT_BGR8_SRGB_PACK32},
+    {95, gli::FORMAT_RGB_BP_UFLOAT_BLOCK16},
+    {96, gli::FORMAT_RGB_BP_SFLOAT_BLOCK16},
+    {98, gli::FORMAT_RGBA_BP_UNORM_BLOCK16},
+    {99, gli::FORMAT_RGBA_BP_SRGB_BLOCK16},
+};
+
+constexpr FormatCode FourCCFormats[] = {
+    {FourCC('D', 'X', 'T', '1'), gli::FORMAT_RGBA_DXT1_UNORM_BLOCK8},
+    {FourCC('D', 'X', 'T', '2'), gli::FORMAT_RGBA_DXT3_UNORM_BLOCK16},
+    {FourCC('D', 'X', 'T', '3'), gli::FORMAT_RGBA_DXT3_UNORM_BLOCK16},
+    {FourCC('D', 'X', 'T', '4'), gli::FORMAT_RGBA_DXT5_UNORM_BLOCK16},
+    {FourCC('D', 'X', 'T', '5'), gli::FORMAT_RGBA_DXT5_UNORM_BLOCK16},
+    {FourCC('A', 'T', 'I', '1'), gli::FORMAT_R_ATI1N_UNORM_BLOCK8},
+    {FourCC('B', 'C', '4', 'U'), gli::FORMAT_R_ATI1N_UNORM_BLOCK8},
+    {FourCC('B', 'C', '4', 'S'), gli::FORMAT_R_ATI1N_SNORM_BLOCK8},
+    {FourCC('A', 'T', 'I', '2'), gli::FORMAT_RG_ATI2N_UNORM_BLOCK16},
+    {FourCC('B', 'C', '5', 'U'), gli::FORMAT_RG_ATI2N_UNORM_BLOCK16},
+    {FourCC('B', 'C', '5', 'S'), gli::FORMAT_RG_ATI2N_SNORM_BLOCK16},
+    // D3DFORMAT values stored in place of a FourCC.
+    {36, gli::FORMAT_RGBA16_UNORM_PACK16},
+    {111, gli::FORMAT_R16_SFLOAT_PACK16},
+    {112, gli::FORMAT_RG16_SFLOAT_PACK16},
+    {113, gli::FORMAT_RGBA16_SFLOAT_PACK16},
+    {114, gli::FORMAT_R32_SFLOAT_PACK32},
+    {115, gli::FORMAT_RG32_SFLOAT_PACK32},
+    {116, gli::FORMAT_RGBA32_SFLOAT_PACK32},
+};
+
+gli::format FindFormat(gsl::span<FormatCode const> codes, uint32_t code) {
+    for (auto &entry : codes) {
+        if (entry.code == code) {
+            return entry.format;
+        }
+    }
+    return gli::FORMAT_UNDEFINED;
+}
+
+gli::format FromMasks(uint32_t flags, uint32_t bits, uint32_t r, uint32_t g, uint32_t b, uint32_t a) {
+    if (!(flags & DDPF_ALPHAPIXELS)) {
+        a = 0;
+    }
+    if (flags & DDPF_RGB) {
+        if (bits == 32 && r == 0x00ff0000 && g == 0x0000ff00 && b == 0x000000ff) {
+            return a == 0xff000000 ? gli::FORMAT_BGRA8_UNORM_PACK8 : gli::FORMAT_BGR8_UNORM_PACK32;
+        }
+        if (bits == 32 && r == 0x000000ff && g == 0x0000ff00 && b == 0x00ff0000 && a == 0xff000000) {
+            return gli::FORMAT_RGBA8_UNORM_PACK8;
+        }
+    } else if (flags & DDPF_LUMINANCE) {
+        if (bits == 8 && r == 0xff) {
+            return gli::FORMAT_L8_UNORM_PACK8;
+        }
+        if (bits == 16 && r == 0xff && a == 0xff00) {
+            return gli::FORMAT_LA8_UNORM_PACK8;
+        }
+    } else if ((flags & DDPF_ALPHAPIXELS) && bits == 8 && a == 0xff) {
+        return gli::FORMAT_A8_UNORM_PACK8;
+    }
+    return gli::FORMAT_UNDEFINED;
+}
+
+uint32_t ReadU32(gsl::span<uint8_t const> data, size_t offset) {
+    uint32_t ret;
+    memcpy(&ret, data.data() + offset, sizeof(ret));
+    return ret;
+}
+
+void WriteU32(std::vector<uint8_t> &data, size_t offset, uint32_t value) {
+    memcpy(data.data() + offset, &value, sizeof(value));
+}
+
+// The FourCC that older readers understand, for the formats that have one.
+uint32_t LegacyFourCC(gli::format format) {
+    switch (format) {
+    case gli::FORMAT_RGBA_DXT1_UNORM_BLOCK8:
+        return FourCC('D', 'X', 'T', '1');
+    case gli::FORMAT_RGBA_DXT3_UNORM_BLOCK16:
+        return FourCC('D', 'X', 'T', '3');
+    case gli::FORMAT_RGBA_DXT5_UNORM_BLOCK16:
+        return FourCC('D', 'X', 'T', '5');
+    case gli::FORMAT_R_ATI1N_UNORM_BLOCK8:
+        return FourCC('A', 'T', 'I', '1');
+    case gli::FORMAT_RG_ATI2N_UNORM_BLOCK16:
+        return FourCC('A', 'T', 'I', '2');
+    default:
+        return 0;
+    }
+}
+} // namespace
+
+glm::ivec2 DdsTexture::LevelExtent(int level) const { return glm::max(extent >> level, glm::ivec2(1)); }
+
+size_t DdsTexture::LevelSize(int level) const {
+    glm::ivec2 blocks = (LevelExtent(level) + blockExtent - 1) / blockExtent;
+    return size_t(blocks.x) * size_t(blocks.y) * blockSize;
+}
+
+size_t DdsTexture::FaceSize() const {
+    size_t ret = 0;
+    for (int level = 0; level < levels; ++level) {
+        ret += LevelSize(level);
+    }
+    return ret;
+}
+
+gsl::span<uint8_t const> DdsTexture::LevelData(int layer, int face, int level) const {
+    if (layer < 0 || layer >= layers || face < 0 || face >= faces || level < 0 || level >= levels) {
+        throw std::runtime_error(
+            fmt::format("texture level out of range: layer={}, face={}, level={}", layer, face, level));
+    }
+    size_t offset = FaceSize() * (size_t(layer) * faces + face);
+    for (int i = 0; i < level; ++i) {
+        offset += LevelSize(i);
+    }
+    size_t size = LevelSize(level);
+    if (offset + size > data.size()) {
+        throw std::runtime_error(fmt::format("texture data truncated, level {} needs {} bytes at offset {} of {}",
+                                             level, size, offset, data.size()));
+    }
+    return data.subspan(offset, size);
+}
+
+std::optional<DdsTexture> ParseDdsHeader(gsl::span<uint8_t const> data) {
+    if (data.size() < 4 || ReadU32(data, 0) != FourCC('D', 'D', 'S', ' ')) {
+        return {};
+    }
+    if (data.size() < 4 + 124) {
+        throw std::runtime_error(fmt::format("DDS header truncated, {} bytes", data.size()));
+    }
+    auto header = data.subspan(4, 124);
+    uint32_t flags = ReadU32(header, 4);
+    uint32_t height = ReadU32(header, 8);
+    uint32_t width = ReadU32(header, 12);
+    uint32_t mipCount = ReadU32(header, 24);
+    uint32_t pfFlags = ReadU32(header, 76);
+    uint32_t fourCC = ReadU32(header, 80);
+    uint32_t caps2 = ReadU32(header, 108);
+
+    DdsTexture ret;
+    ret.headerSize = 4 + 124;
+    if (width == 0 || height == 0 || width > (1u << 16) || height > (1u << 16)) {
+        throw std::runtime_error(fmt::format("invalid DDS dimensions {}x{}", width, height));
+    }
+    ret.extent = glm::ivec2(width, height);
+    if (caps2 & DDSCAPS2_VOLUME) {
+        return {};
+    }
+    if (caps2 & DDSCAPS2_CUBEMAP) {
+        ret.faces = 6;
+    }
+
+    if ((pfFlags & DDPF_FOURCC) && fourCC == FourCC('D', 'X', '1', '0')) {
+        if (data.size() < DdsMaxHeaderSize) {
+            throw std::runtime_error(fmt::format("DDS DX10 header truncated, {} bytes", data.size()));
+        }
+        auto dx10 = data.subspan(4 + 124, 20);
+        ret.headerSize = DdsMaxHeaderSize;
+        ret.format = FindFormat(DxgiFormats, ReadU32(dx10, 0));
+        if (ReadU32(dx10, 4) == DDS_DIMENSION_TEXTURE3D) {
+            return {};
+        }
+        ret.faces = (ReadU32(dx10, 8) & DDS_RESOURCE_MISC_TEXTURECUBE) ? 6 : 1;
+        ret.layers = std::max<int>(1, static_cast<int>(std::min<uint32_t>(ReadU32(dx10, 12), 1u << 16)));
+    } else if (pfFlags & DDPF_FOURCC) {
+        ret.format = FindFormat(FourCCFormats, fourCC);
+    } else {
+        ret.format = FromMasks(pfFlags, ReadU32(header, 84), ReadU32(header, 88), ReadU32(header, 92),
+                               ReadU32(header, 96), ReadU32(header, 100));
+    }
+    FormatInfo info = Info(ret.format);
+    if (info.format == gli::FORMAT_UNDEFINED) {
+        return {};
+    }
+    ret.blockExtent = glm::ivec2(info.blockDim);
+    ret.blockSize = info.blockSize;
+
+    // Some writers leave the flag out but still fill in the count.
+    int maxLevels = 1;
+    while ((std::max(width, height) >> maxLevels) != 0) {
+        ++maxLevels;
+    }
+    if ((flags & DDSD_MIPMAPCOUNT) || mipCount > 1) {
+        ret.levels = std::clamp<int>(static_cast<int>(std::min<uint32_t>(mipCount, 32)), 1, maxLevels);
+    }
+
+    return ret;
+}
+
+std::optional<DdsTexture> ParseDds(gsl::span<uint8_t const> data) {
+    auto ret = ParseDdsHeader(data);
+    if (!ret) {
+        return {};
+    }
+    ret->data = data.subspan(ret->headerSize);
+    while (ret->levels > 1 && ret->DataSize() > ret->data.size()) {
+        --ret->levels;
+    }
+    if (ret->DataSize() > ret->data.size()) {
+        throw std::runtime_error(fmt::format("DDS data truncated, {} bytes for {}x{} texture", ret->data.size(),
+                                             ret->extent.x, ret->extent.y));
+    }
+    return ret;
+}
+
+std::vector<uint8_t> WriteDdsHeader(gli::format format, glm::ivec2 extent, int levels) {
+    FormatInfo info = Info(format);
+    uint32_t dxgiFormat = 0;
+    for (auto &entry : DxgiFormats) {
+        if (entry.format == format) {
+            dxgiFormat = entry.code;
+            break;
+        }
+    }
+    if (info.format == gli::FORMAT_UNDEFINED || dxgiFormat == 0) {
+        throw std::runtime_error(fmt::format("no DDS format for gli format {}", int(format)));
+    }
+    if (extent.x <= 0 || extent.y <= 0 || extent.x > (1 << 16) || extent.y > (1 << 16) || levels < 1) {
+        throw std::runtime_error(fmt::format("invalid DDS dimensions {}x{}, {} levels", extent.x, extent.y, levels));
+    }
+
+    uint32_t fourCC = LegacyFourCC(format);
+    std::vector<uint8_t> ret(fourCC ? 4 + 124 : DdsMaxHeaderSize);
+    WriteU32(ret, 0, FourCC('D', 'D', 'S', ' '));
+    // Offsets are into DDS_HEADER, which follows the magic.
+    auto put = [&](size_t offset, uint32_t value) { WriteU32(ret, 4 + offset, value); };
+
+    bool compressed = info.blockDim > 1;
+    uint32_t blocksWide = (extent.x + info.blockDim - 1) / info.blockDim;
+    uint32_t blocksHigh = (extent.y + info.blockDim - 1) / info.blockDim;
+    put(0, 124);
+    put(4, DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | (levels > 1 ? DDSD_MIPMAPCOUNT : 0) |
+               (compressed ? DDSD_LINEARSIZE : DDSD_PITCH));
+    put(8, extent.y);
+    put(12, extent.x);
+    put(16, uint32_t(compressed ? blocksWide * blocksHigh * info.blockSize : blocksWide * info.blockSize));
+    put(24, levels);
+    put(72, 32);
+    put(76, DDPF_FOURCC);
+    put(80, fourCC ? fourCC : FourCC('D', 'X', '1', '0'));
+    put(104, DDSCAPS_TEXTURE | (levels > 1 ? DDSCAPS_COMPLEX | DDSCAPS_MIPMAP : 0));
+    if (!fourCC) {
+        WriteU32(ret, 4 + 124, dxgiFormat);
+        WriteU32(ret, 4 + 124 + 4, DDS_DIMENSION_TEXTURE2D);
+        WriteU32(ret, 4 + 124 + 12, 1);
+    }
+    return ret;
+}
@@ -0,0 +1,58 @@
+#ifndef DDS_H
+#define DDS_H
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include <gli/format.hpp>
+#include <glm/glm.hpp>
+#include <gsl/span>
+
+// Magic, DDS_HEADER and DDS_HEADER_DXT10, everything needed to describe a texture without its pixel data.
+constexpr size_t DdsMaxHeaderSize = 4 + 124 + 20;
+
+// Layout of a DDS texture. The data spans point into the buffer the header was parsed from, nothing is copied.
+struct DdsTexture {
+    gli::format format{gli::FORMAT_UNDEFINED};
+    glm::ivec2 extent{};
+    int levels{1};
+    int layers{1};
+    int faces{1};
+
+    // Texels per block and bytes per block, 1x1 blocks for uncompressed formats.
+    glm::ivec2 blockExtent{1, 1};
+    size_t blockSize{};
+
+    size_t headerSize{};
+    // Everything after the header, empty if only the header was parsed.
+    gsl::span<uint8_t const> data;
+
+    glm::ivec2 LevelExtent(int level) const;
+    size_t LevelSize(int level) const;
+    // Bytes of all levels of one face of one layer.
+    size_t FaceSize() const;
+    size_t DataSize() const { return FaceSize() * layers * faces; }
+
+    // One level of one face, throws if the parsed buffer does not hold it.
+    gsl::span<uint8_t const> LevelData(int layer, int face, int level) const;
+};
+
+// Parses the legacy or DX10 header at the start of data, looking at no more than the first DdsMaxHeaderSize bytes.
+// Returns nothing for data that is not DDS or for a pixel format the parser does not know, so that the caller can fall
+// back to a general loader, and throws for headers that are malformed.
+//
+// Files from Path of Exile are taken as they are: zero structure sizes, mip counts without the flag saying so and DX10
+// array sizes of zero are accepted.
+std::optional<DdsTexture> ParseDdsHeader(gsl::span<uint8_t const> data);
+
+// Parses a whole DDS file. Mip counts are clamped to the levels that the file actually holds, as some files claim
+// more than they have.
+std::optional<DdsTexture> ParseDds(gsl::span<uint8_t const> data);
+
+// Header of a DDS file holding one 2D texture, with the data of its levels to follow from the largest down. Formats
+// from BC1 to BC5 that older readers know get a legacy FourCC header, everything else a DX10 one. Throws for formats
+// that ParseDdsHeader would not read back.
+std::vector<uint8_t> WriteDdsHeader(gli::format format, glm::ivec2 extent, int levels);
+
+#endif // DDS_H
@@ -0,0 +1,184 @@
+#include "decompress.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <stdexcept>
+
+#include <fmt/core.h>
+
+#include "cmp_core.h"
+#include "gli_format_names.h"
+#include "stats.h"
+#include "thread_pool.h"
+
+// sRGB and linear variants decode to the same bytes, no conversion is done either way. CMP_Core only decodes unsigned
+// BC6H.
+BlockDecoder::BlockDecoder(gli::format format) {
+    switch (format) {
+    case gli::FORMAT_RGBA_DXT1_UNORM_BLOCK8:
+    case gli::FORMAT_RGBA_DXT1_SRGB_BLOCK8:
+        codec = Codec::Bc1;
+        CreateOptionsBC1(&options);
+        break;
+    case gli::FORMAT_RGBA_DXT3_UNORM_BLOCK16:
+    case gli::FORMAT_RGBA_DXT3_SRGB_BLOCK16:
+        codec = Codec::Bc2;
+        CreateOptionsBC2(&options);
+        break;
+    case gli::FORMAT_RGBA_DXT5_UNORM_BLOCK16:
+    case gli::FORMAT_RGBA_DXT5_SRGB_BLOCK16:
+        codec = Codec::Bc3;
+        CreateOptionsBC3(&options);
+        break;
+    case gli::FORMAT_R_ATI1N_UNORM_BLOCK8:
+    case gli::FORMAT_R_ATI1N_SNORM_BLOCK8:
+        codec = format == gli::FORMAT_R_ATI1N_SNORM_BLOCK8 ? Codec::Bc4Signed : Codec::Bc4;
+        CreateOptionsBC4(&options);
+        break;
+    case gli::FORMAT_RG_ATI2N_UNORM_BLOCK16:
+    case gli::FORMAT_RG_ATI2N_SNORM_BLOCK16:
+        codec = format == gli::FORMAT_RG_ATI2N_SNORM_BLOCK16 ? Codec::Bc5Signed : Codec::Bc5;
+        CreateOptionsBC5(&options);
+        break;
+    case gli::FORMAT_RGB_BP_UFLOAT_BLOCK16:
+        codec = Codec::Bc6;
+        CreateOptionsBC6(&options);
+        break;
+    case gli::FORMAT_RGBA_BP_UNORM_BLOCK16:
+    case gli::FORMAT_RGBA_BP_SRGB_BLOCK16:
+        // BC7 decoding reads no options, and making them would build the encoder's tables.
+        codec = Codec::Bc7;
+        break;
+    default:
+        throw std::runtime_error(fmt::format("unhandled format {} ({})", GliFormatName(format), format));
+    }
+    blockSize = codec == Codec::Bc1 || codec == Codec::Bc4 || codec == Codec::Bc4Signed ? 8 : 16;
+    pixelSize = codec == Codec::Bc4 || codec == Codec::Bc4Signed   ? 1
+                : codec == Codec::Bc5 || codec == Codec::Bc5Signed ? 2
+                : codec == Codec::Bc6                              ? 6
+                                                                   : 4;
+}
+
+BlockDecoder::~BlockDecoder() {
+    switch (codec) {
+    case Codec::Bc1:
+        DestroyOptionsBC1(options);
+        break;
+    case Codec::Bc2:
+        DestroyOptionsBC2(options);
+        break;
+    case Codec::Bc3:
+        DestroyOptionsBC3(options);
+        break;
+    case Codec::Bc4:
+    case Codec::Bc4Signed:
+        DestroyOptionsBC4(options);
+        break;
+    case Codec::Bc5:
+    case Codec::Bc5Signed:
+        DestroyOptionsBC5(options);
+        break;
+    case Codec::Bc6:
+        DestroyOptionsBC6(options);
+        break;
+    case Codec::Bc7:
+        break;
+    }
+}
+
+void BlockDecoder::DecodeBlock(uint8_t const *block, uint8_t *pixels) const {
+    switch (codec) {
+    case Codec::Bc1:
+        DecompressBlockBC1(block, pixels, options);
+        break;
+    case Codec::Bc2:
+        DecompressBlockBC2(block, pixels, options);
+        break;
+    case Codec::Bc3:
+        DecompressBlockBC3(block, pixels, options);
+        break;
+    case Codec::Bc4:
+        DecompressBlockBC4(block, pixels, options);
+        break;
+    case Codec::Bc4Signed:
+        DecompressBlockBC4S(block, reinterpret_cast<char *>(pixels), options);
+        break;
+    case Codec::Bc5:
+    case Codec::Bc5Signed: {
+        // CMP_Core gives the two channels as separate planes.
+        uint8_t red[16], green[16];
+        if (codec == Codec::Bc5) {
+            DecompressBlockBC5(block, red, green, options);
+        } else {
+            DecompressBlockBC5S(block, reinterpret_cast<char *>(red), reinterpret_cast<char *>(green), options);
+        }
+        for (int i = 0; i < 16; ++i) {
+            pixels[2 * i] = red[i];
+            pixels[2 * i + 1] = green[i];
+        }
+    } break;
+    case Codec::Bc6:
+        DecompressBlockBC6(block, reinterpret_cast<unsigned short *>(pixels), options);
+        break;
+    case Codec::Bc7:
+        DecompressBlockBC7(block, pixels, nullptr);
+        break;
+    }
+}
+
+void BlockDecoder::DecodeRow(uint8_t const *blocks, int x, int width, int firstRow, int rowCount, uint8_t *dst,
+                             size_t pitch) const {
+    alignas(16) uint8_t pixels[16 * 6];
+    size_t blockPitch = 4 * size_t(pixelSize);
+    for (int blockX = x / 4; blockX * 4 < x + width; ++blockX) {
+        DecodeBlock(blocks + blockX * blockSize, pixels);
+        int begin = std::max(blockX * 4, x), end = std::min(blockX * 4 + 4, x + width);
+        size_t bytes = size_t(end - begin) * pixelSize;
+        uint8_t const *in = pixels + firstRow * blockPitch + size_t(begin - blockX * 4) * pixelSize;
+        uint8_t *out = dst + size_t(begin - x) * pixelSize;
+        for (int row = 0; row < rowCount; ++row) {
+            memcpy(out + row * pitch, in + row * blockPitch, bytes);
+        }
+    }
+}
+
+void DecompressTexture(gli::format format, int width, int height, gsl::span<uint8_t const> src, uint8_t *dst,
+                       size_t dstPitch, ThreadPool &pool) {
+    size_t blockSize = BlockDecoder(format).BlockSize();
+    if (width <= 0 || height <= 0) {
+        return;
+    }
+    int blocksPerRow = (width + 3) / 4, blockRows = (height + 3) / 4;
+    size_t rowSize = size_t(blocksPerRow) * blockSize;
+    if (src.size() < rowSize * blockRows) {
+        throw std::runtime_error(fmt::format("{} bytes of {} data, {}x{} needs {}", src.size(), GliFormatName(format),
+                                             width, height, rowSize * blockRows));
+    }
+
+    // Several bands per thread so that a thread that finishes early takes over rows from the others.
+    unsigned threads = pool.ThreadCount();
+    int rowsPerBand = std::max(1, blockRows / int(threads * 8));
+    int bandCount = (blockRows + rowsPerBand - 1) / rowsPerBand;
+    std::atomic<int> nextBand{0};
+    auto decodeBands = [&] {
+        PhaseTimer timer(Phase::Decode);
+        BlockDecoder decoder(format);
+        for (int band; (band = nextBand++) < bandCount;) {
+            int begin = band * rowsPerBand, end = std::min(begin + rowsPerBand, blockRows);
+            BlockTimer blocks(format, uint64_t(end - begin) * blocksPerRow);
+            for (int blockY = begin; blockY < end; ++blockY) {
+                int rows = std::min(height - 4 * blockY, 4);
+                decoder.DecodeRow(src.data() + blockY * rowSize, 0, width, 0, rows, dst + 4 * blockY * dstPitch,
+                                  dstPitch);
+            }
+        }
+    };
+
+    TaskGroup group(pool);
+    unsigned tasks = std::min(threads, unsigned(bandCount));
+    for (unsigned i = 0; i < tasks; ++i) {
+        group.Run(decodeBands);
+    }
+    group.Wait();
+}
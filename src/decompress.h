@@ -0,0 +1,49 @@
+#ifndef DECOMPRESS_H
+#define DECOMPRESS_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include <gli/format.hpp>
+#include <gsl/span>
+
+class ThreadPool;
+
+// Decodes the blocks of one BCn format with CMP_Core. Pixels come out as RGBA8 for BC1 to BC3 and BC7, R8 for BC4, RG8
+// for BC5 and RGB16F for BC6H, with signed bytes for the signed variants of BC4 and BC5. The CMP_Core options are made
+// once per decoder rather than defaulted again for every block, so a decoder is meant to be used by one thread at a
+// time and to be kept for as many blocks as it can.
+class BlockDecoder {
+  public:
+    explicit BlockDecoder(gli::format format);
+    ~BlockDecoder();
+
+    BlockDecoder(BlockDecoder const &) = delete;
+    BlockDecoder &operator=(BlockDecoder const &) = delete;
+
+    size_t BlockSize() const { return blockSize; }
+    int PixelSize() const { return pixelSize; }
+
+    // Decodes pixel columns [x, x + width) of a row of blocks, starting at `blocks`, and writes the rows
+    // [firstRow, firstRow + rowCount) of the blocks to `dst`, `pitch` bytes apart.
+    void DecodeRow(uint8_t const *blocks, int x, int width, int firstRow, int rowCount, uint8_t *dst,
+                   size_t pitch) const;
+
+  private:
+    enum class Codec { Bc1, Bc2, Bc3, Bc4, Bc4Signed, Bc5, Bc5Signed, Bc6, Bc7 };
+
+    void DecodeBlock(uint8_t const *block, uint8_t *pixels) const;
+
+    Codec codec{};
+    size_t blockSize{};
+    int pixelSize{};
+    void *options{};
+};
+
+// Decodes one level of a BCn texture to `dst`, whose rows are `dstPitch` bytes apart, with pixels as BlockDecoder gives
+// them. Bands of block rows are decoded by one task per pool thread, the calling thread helping while it waits, and
+// each task keeps one decoder for all the bands it takes.
+void DecompressTexture(gli::format format, int width, int height, gsl::span<uint8_t const> src, uint8_t *dst,
+                       size_t dstPitch, ThreadPool &pool);
+
+#endif // DECOMPRESS_H
@@ -0,0 +1,410 @@
+#include "file_reader.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#include <fmt/core.h>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define PROCESS_IMAGE_IO_URING 1
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <linux/stat.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+ReadBackend ParseReadBackend(std::string_view name) {
+    if (name == "threads") {
+        return ReadBackend::Threads;
+    }
+    if (name == "io_uring") {
+        if (!IoUringAvailable()) {
+            throw std::runtime_error("io_uring is not available on this system");
+        }
+        return ReadBackend::IoUring;
+    }
+    if (name == "auto") {
+        return IoUringAvailable() ? ReadBackend::IoUring : ReadBackend::Threads;
+    }
+    throw std::runtime_error(fmt::format("unknown read backend, expected threads, io_uring or auto: {}", name));
+}
+
+char const *ReadBackendName(ReadBackend backend) {
+    switch (backend) {
+    case ReadBackend::Threads:
+        return "threads";
+    case ReadBackend::IoUring:
+        return "io_uring";
+    }
+    return "unknown";
+}
+
+namespace {
+class ThreadsFileReader : public FileReader {
+  public:
+
+    bool CanSubmit() const override { return !queued; }
+    void Submit(size_t tag, std::string path) override {
+        queued = true;
+        queuedTag = tag;
+        queuedPath = std::move(path);
+    }
+    size_t Pending() const override { return queued ? 1 : 0; }
+
+    void Collect(std::vector<FileRead> &done) override {
+        FileRead read;
+        read.tag = queuedTag;
+        queued = false;
+        try {
+            std::unique_ptr<FILE, decltype(&fclose)> fh(fopen(queuedPath.c_str(), "rb"), &fclose);
+            if (!fh) {
+                throw std::runtime_error(fmt::format("could not open file: {}", queuedPath));
+            }
+            long size = -1;
+            if (fseek(fh.get(), 0, SEEK_END) == 0) {
+                size = ftell(fh.get());
+            }
+            if (size < 0 || fseek(fh.get(), 0, SEEK_SET) != 0) {
+                throw std::runtime_error(fmt::format("could not read file: {}", queuedPath));
+            }
+            read.data = PixelBuffer(size);
+            read.data.truncate(fread(read.data.data(), 1, read.data.size(), fh.get()));
+            if (ferror(fh.get())) {
+                throw std::runtime_error(fmt::format("could not read file: {}", queuedPath));
+            }
+        } catch (std::exception &) {
+            read.error = std::current_exception();
+        }
+        done.push_back(std::move(read));
+    }
+
+  private:
+    bool queued{};
+    size_t queuedTag{};
+    std::string queuedPath;
+};
+
+#ifdef PROCESS_IMAGE_IO_URING
+int IoUringSetup(unsigned entries, io_uring_params *params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int IoUringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0));
+}
+
+int IoUringRegister(int fd, unsigned opcode, void *arg, unsigned argCount) {
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, argCount));
+}
+
+// Each file goes through an open and a statx submitted together, then reads until it is complete, then a close that
+// nobody waits for.
+class IoUringFileReader : public FileReader {
+  public:
+    explicit IoUringFileReader(unsigned depth) : slots(depth ? depth : 1) {
+        io_uring_params params{};
+        ringFd = IoUringSetup(static_cast<unsigned>(slots.size() * 4), &params);
+        if (ringFd < 0) {
+            throw std::runtime_error(fmt::format("could not set up io_uring: {}", strerror(errno)));
+        }
+        sqRingSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+        cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        if (params.features & IORING_FEAT_SINGLE_MMAP) {
+            sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+        }
+        sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        try {
+            sqRing = Map(sqRingSize, IORING_OFF_SQ_RING);
+            cqRing = (params.features & IORING_FEAT_SINGLE_MMAP) ? sqRing : Map(cqRingSize, IORING_OFF_CQ_RING);
+            sqes = static_cast<io_uring_sqe *>(Map(sqesSize, IORING_OFF_SQES));
+        } catch (...) {
+            Unmap();
+            throw;
+        }
+
+        auto at = [](void *ring, uint32_t offset) {
+            return reinterpret_cast<uint32_t *>(static_cast<char *>(ring) + offset);
+        };
+        sqTail = at(sqRing, params.sq_off.tail);
+        sqMask = *at(sqRing, params.sq_off.ring_mask);
+        sqArray = at(sqRing, params.sq_off.array);
+        cqHead = at(cqRing, params.cq_off.head);
+        cqTail = at(cqRing, params.cq_off.tail);
+        cqMask = *at(cqRing, params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe *>(static_cast<char *>(cqRing) + params.cq_off.cqes);
+        localSqTail = *sqTail;
+
+        for (size_t i = 0; i < slots.size(); ++i) {
+            freeSlots.push_back(slots.size() - 1 - i);
+        }
+    }
+
+    ~IoUringFileReader() override {
+        // The kernel may still write into buffers and statx results of cancelled files, drain everything first.
+        while (inFlight) {
+            if (Enter(1) < 0 && errno != EINTR) {
+                break;
+            }
+            Reap(nullptr);
+        }
+        for (auto &slot : slots) {
+            if (slot.fd >= 0) {
+                close(slot.fd);
+            }
+        }
+        Unmap();
+    }
+
+    bool CanSubmit() const override { return !freeSlots.empty(); }
+
+    void Submit(size_t tag, std::string path) override {
+        size_t index = freeSlots.back();
+        freeSlots.pop_back();
+        auto &slot = slots[index];
+        slot = Slot{};
+        slot.tag = tag;
+        slot.path = std::move(path);
+        slot.waitingFor = 2;
+        ++pending;
+
+        auto &open = PushSqe(index, Op::Open);
+        open.fd = AT_FDCWD;
+        open.addr = reinterpret_cast<uintptr_t>(slot.path.c_str());
+        open.open_flags = O_RDONLY | O_CLOEXEC;
+
+        auto &stat = PushSqe(index, Op::Stat);
+        stat.fd = AT_FDCWD;
+        stat.addr = reinterpret_cast<uintptr_t>(slot.path.c_str());
+        stat.len = STATX_SIZE;
+        stat.off = reinterpret_cast<uintptr_t>(&slot.stat);
+    }
+
+    size_t Pending() const override { return pending; }
+
+    void Collect(std::vector<FileRead> &done) override {
+        size_t before = done.size();
+        while (pending && done.size() == before) {
+            // Everything queued so far goes to the kernel in one call, which then waits for a completion.
+            if (Enter(Ready() ? 0 : 1) < 0 && errno != EINTR) {
+                throw std::runtime_error(fmt::format("io_uring_enter failed: {}", strerror(errno)));
+            }
+            Reap(&done);
+        }
+        // Start the reads and closes queued while reaping, so that they progress while the caller is busy.
+        if (unsubmitted && Enter(0) < 0 && errno != EINTR) {
+            throw std::runtime_error(fmt::format("io_uring_enter failed: {}", strerror(errno)));
+        }
+    }
+
+  private:
+    enum class Op : uint64_t { Open, Stat, Read, Close };
+
+    struct Slot {
+        size_t tag{};
+        std::string path;
+        int waitingFor{};
+        int fd{-1};
+        struct statx stat {};
+        PixelBuffer data;
+        size_t offset{};
+        std::string error;
+    };
+
+    void Unmap() {
+        if (sqes) {
+            munmap(sqes, sqesSize);
+        }
+        if (cqRing && cqRing != sqRing) {
+            munmap(cqRing, cqRingSize);
+        }
+        if (sqRing) {
+            munmap(sqRing, sqRingSize);
+        }
+        close(ringFd);
+    }
+
+    void *Map(size_t size, uint64_t offset) {
+        void *ret = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, offset);
+        if (ret == MAP_FAILED) {
+            throw std::runtime_error(fmt::format("could not map io_uring: {}", strerror(errno)));
+        }
+        return ret;
+    }
+
+    io_uring_sqe &PushSqe(size_t slot, Op op) {
+        uint32_t index = localSqTail & sqMask;
+        auto &sqe = sqes[index];
+        memset(&sqe, 0, sizeof(sqe));
+        switch (op) {
+        case Op::Open:
+            sqe.opcode = IORING_OP_OPENAT;
+            break;
+        case Op::Stat:
+            sqe.opcode = IORING_OP_STATX;
+            break;
+        case Op::Read:
+            sqe.opcode = IORING_OP_READ;
+            break;
+        case Op::Close:
+            sqe.opcode = IORING_OP_CLOSE;
+            break;
+        }
+        sqe.user_data = (static_cast<uint64_t>(slot) << 2) | static_cast<uint64_t>(op);
+        sqArray[index] = index;
+        ++localSqTail;
+        ++unsubmitted;
+        ++inFlight;
+        return sqe;
+    }
+
+    bool Ready() const {
+        return __atomic_load_n(cqHead, __ATOMIC_RELAXED) != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+    }
+
+    int Enter(unsigned minComplete) {
+        __atomic_store_n(sqTail, localSqTail, __ATOMIC_RELEASE);
+        if (!unsubmitted && !minComplete) {
+            return 0;
+        }
+        int ret = IoUringEnter(ringFd, unsubmitted, minComplete, minComplete ? IORING_ENTER_GETEVENTS : 0);
+        if (ret >= 0) {
+            unsubmitted -= ret;
+        }
+        return ret;
+    }
+
+    void QueueRead(size_t index) {
+        auto &slot = slots[index];
+        auto &read = PushSqe(index, Op::Read);
+        read.fd = slot.fd;
+        read.addr = reinterpret_cast<uintptr_t>(slot.data.data() + slot.offset);
+        read.len = static_cast<uint32_t>(std::min<size_t>(slot.data.size() - slot.offset, 1u << 30));
+        read.off = slot.offset;
+    }
+
+    // Hands the file over to the caller and closes it in the background.
+    void Finish(size_t index, std::vector<FileRead> *done) {
+        auto &slot = slots[index];
+        FileRead read;
+        read.tag = slot.tag;
+        if (!slot.error.empty()) {
+            read.error = std::make_exception_ptr(std::runtime_error(slot.error));
+        } else {
+            read.data = std::move(slot.data);
+        }
+        if (slot.fd >= 0) {
+            auto &close = PushSqe(index, Op::Close);
+            close.fd = slot.fd;
+            slot.fd = -1;
+        }
+        freeSlots.push_back(index);
+        --pending;
+        if (done) {
+            done->push_back(std::move(read));
+        }
+    }
+
+    void Reap(std::vector<FileRead> *done) {
+        uint32_t head = *cqHead;
+        uint32_t tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head) {
+            io_uring_cqe const &cqe = cqes[head & cqMask];
+            size_t index = cqe.user_data >> 2;
+            auto op = static_cast<Op>(cqe.user_data & 3);
+            int res = cqe.res;
+            --inFlight;
+            if (op == Op::Close) {
+                continue;
+            }
+            auto &slot = slots[index];
+            if (op == Op::Open || op == Op::Stat) {
+                if (op == Op::Open && res >= 0) {
+                    slot.fd = res;
+                } else if (res < 0 && slot.error.empty()) {
+                    slot.error = fmt::format("could not open file: {}: {}", slot.path, strerror(-res));
+                }
+                if (--slot.waitingFor == 0) {
+                    if (!slot.error.empty()) {
+                        Finish(index, done);
+                    } else {
+                        slot.data = PixelBuffer(slot.stat.stx_size);
+                        if (slot.data.empty()) {
+                            Finish(index, done);
+                        } else {
+                            QueueRead(index);
+                        }
+                    }
+                }
+            } else if (res < 0) {
+                slot.error = fmt::format("could not read file: {}: {}", slot.path, strerror(-res));
+                Finish(index, done);
+            } else {
+                slot.offset += res;
+                // A file that shrank since statx ends early, one that grew is cut off at its old size.
+                if (res == 0) {
+                    slot.data.truncate(slot.offset);
+                }
+                if (slot.offset == slot.data.size()) {
+                    Finish(index, done);
+                } else {
+                    QueueRead(index);
+                }
+            }
+        }
+        __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+    }
+
+    std::vector<Slot> slots;
+    std::vector<size_t> freeSlots;
+    size_t pending{};
+    size_t inFlight{};
+    unsigned unsubmitted{};
+
+    int ringFd{-1};
+    void *sqRing{}, *cqRing{};
+    size_t sqRingSize{}, cqRingSize{}, sqesSize{};
+    io_uring_sqe *sqes{};
+    uint32_t *sqTail{}, *sqArray{}, *cqHead{}, *cqTail{};
+    uint32_t sqMask{}, cqMask{}, localSqTail{};
+    io_uring_cqe *cqes{};
+};
+#endif
+} // namespace
+
+bool IoUringAvailable() {
+#ifdef PROCESS_IMAGE_IO_URING
+    static bool const available = [] {
+        io_uring_params params{};
+        int fd = IoUringSetup(4, &params);
+        if (fd < 0) {
+            return false;
+        }
+        // Opens, statx and plain reads arrived over several kernel versions, check for each of them.
+        constexpr unsigned OpCount = 64;
+        std::vector<uint8_t> storage(sizeof(io_uring_probe) + OpCount * sizeof(io_uring_probe_op));
+        auto *probe = reinterpret_cast<io_uring_probe *>(storage.data());
+        bool ret = IoUringRegister(fd, IORING_REGISTER_PROBE, probe, OpCount) >= 0;
+        for (unsigned op : {IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_READ, IORING_OP_CLOSE}) {
+            ret = ret && op <= probe->last_op && (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+        }
+        close(fd);
+        return ret;
+    }();
+    return available;
+#else
+    return false;
+#endif
+}
+
+std::unique_ptr<FileReader> MakeFileReader(ReadBackend backend, unsigned depth) {
+#ifdef PROCESS_IMAGE_IO_URING
+    if (backend == ReadBackend::IoUring) {
+        return std::make_unique<IoUringFileReader>(depth);
+    }
+#endif
+    return std::make_unique<ThreadsFileReader>();
+}
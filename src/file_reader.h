@@ -0,0 +1,54 @@
+#ifndef FILE_READER_H
+#define FILE_READER_H
+
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "pixel_buffer.h"
+
+enum class ReadBackend {
+    // Each reading thread reads one file at a time with plain blocking calls.
+    Threads,
+    // Each reading thread keeps many opens and reads in flight on its own io_uring instance.
+    IoUring,
+};
+
+// Parses "threads", "io_uring" or "auto", the latter picking io_uring when the system supports it.
+ReadBackend ParseReadBackend(std::string_view name);
+char const *ReadBackendName(ReadBackend backend);
+
+// Whether this build and the running kernel support everything the io_uring backend needs.
+bool IoUringAvailable();
+
+struct FileRead {
+    size_t tag{};
+    // Taken from the reading thread's pixel buffer pool, and back to it once the last owner is done with it, so that
+    // reading many small files does not allocate and fault in fresh memory for each one of them.
+    PixelBuffer data;
+    std::exception_ptr error;
+};
+
+// Reads whole files into pooled buffers, possibly several at once. A reader belongs to a single thread.
+class FileReader {
+  public:
+    virtual ~FileReader() = default;
+
+    // Whether another read may be submitted before collecting finished ones.
+    virtual bool CanSubmit() const = 0;
+    virtual void Submit(size_t tag, std::string path) = 0;
+
+    // Submitted reads that have not been collected yet.
+    virtual size_t Pending() const = 0;
+
+    // Blocks until at least one pending read has finished and appends all finished reads to `done`.
+    virtual void Collect(std::vector<FileRead> &done) = 0;
+};
+
+// `depth` is how many files the io_uring backend keeps in flight.
+std::unique_ptr<FileReader> MakeFileReader(ReadBackend backend, unsigned depth);
+
+#endif // FILE_READER_H
@@ -0,0 +1,419 @@
+// Seeded synthetic DDS textures for benchmarks and tests that must not depend on game assets. Each texture is drawn as
+// RGBA8 and then stored in the requested formats, with the block compressed ones encoded by CMP_Core, so that the same
+// seed gives the same files on every machine.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <filesystem>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include "compress.h"
+#include "convert.h"
+#include "dds.h"
+#include "thread_pool.h"
+
+namespace {
+struct OutputFormat {
+    char const *name;
+    gli::format format;
+};
+
+// Every format that process-image decodes, the sRGB variants aside as they hold the same bytes.
+constexpr OutputFormat Formats[] = {
+    {"bc1", gli::FORMAT_RGBA_DXT1_UNORM_BLOCK8},  {"bc2", gli::FORMAT_RGBA_DXT3_UNORM_BLOCK16},
+    {"bc3", gli::FORMAT_RGBA_DXT5_UNORM_BLOCK16}, {"bc7", gli::FORMAT_RGBA_BP_UNORM_BLOCK16},
+    {"rgba8", gli::FORMAT_RGBA8_UNORM_PACK8},     {"bgra8", gli::FORMAT_BGRA8_UNORM_PACK8},
+    {"bgrx8", gli::FORMAT_BGR8_UNORM_PACK32},     {"rg8", gli::FORMAT_RG8_UNORM_PACK8},
+};
+
+enum class Content {
+    // Independent random texels, the worst case for every encoder and for PNG.
+    Noise,
+    // Smooth blends between two colours.
+    Gradient,
+    // Flat rectangles with borders, like interface art.
+    Panel,
+    // Soft edged shapes on a transparent background.
+    Sprite,
+};
+
+constexpr char const *ContentNames[] = {"noise", "gradient", "panel", "sprite"};
+
+struct GenOptions {
+    int size = 512;
+    int count = 1;
+    uint32_t seed = 1;
+    float quality = 0.05f;
+    unsigned threads = std::max(std::thread::hardware_concurrency(), 1u);
+    std::vector<OutputFormat> formats{std::begin(Formats), std::end(Formats)};
+    std::vector<Content> contents{Content::Noise, Content::Gradient, Content::Panel, Content::Sprite};
+    // Sets of BC7 modes the encoder may pick from, one texture per set.
+    std::vector<uint8_t> bc7Modes{0xff};
+};
+
+struct Rgba {
+    uint8_t r, g, b, a;
+};
+
+// Random values are taken from the generator's raw output and everything drawn is worked out with integers, as the
+// standard distributions and the maths library differ between standard libraries and would change the texels.
+int Below(std::mt19937 &rng, int n) { return int(rng() % uint32_t(n)); }
+
+uint8_t RandomByte(std::mt19937 &rng) { return uint8_t(rng() >> 24); }
+
+Rgba RandomColour(std::mt19937 &rng) {
+    uint8_t r = RandomByte(rng), g = RandomByte(rng), b = RandomByte(rng);
+    return {r, g, b, 255};
+}
+
+void Store(std::vector<uint8_t> &pixels, size_t index, Rgba c) {
+    pixels[index * 4 + 0] = c.r;
+    pixels[index * 4 + 1] = c.g;
+    pixels[index * 4 + 2] = c.b;
+    pixels[index * 4 + 3] = c.a;
+}
+
+// Tightly packed RGBA8 pixels.
+std::vector<uint8_t> Draw(Content content, int size, std::mt19937 &rng) {
+    std::vector<uint8_t> pixels(size_t(size) * size * 4);
+    switch (content) {
+    case Content::Noise: {
+        for (size_t i = 0; i < pixels.size(); ++i) {
+            pixels[i] = (i % 4 == 3) ? 255 : RandomByte(rng);
+        }
+    } break;
+    case Content::Gradient: {
+        Rgba from = RandomColour(rng), to = RandomColour(rng);
+        int dx = Below(rng, 513) - 256, dy = Below(rng, 513) - 256;
+        if (dx == 0 && dy == 0) {
+            dx = 256;
+        }
+        // Positions along the direction are measured at texel centres, in units of half a texel.
+        int64_t lo = 2 * int64_t(size) * (std::min(0, dx) + std::min(0, dy));
+        int64_t range = 2 * int64_t(size) * (std::abs(dx) + std::abs(dy));
+        auto blend = [&](uint8_t a, uint8_t b, int64_t t) {
+            return uint8_t((a * (range - t) + b * t + range / 2) / range);
+        };
+        for (int y = 0; y < size; ++y) {
+            for (int x = 0; x < size; ++x) {
+                int64_t t = int64_t(2 * x + 1) * dx + int64_t(2 * y + 1) * dy - lo;
+                Store(pixels, size_t(y) * size + x,
+                      {blend(from.r, to.r, t), blend(from.g, to.g, t), blend(from.b, to.b, t), 255});
+            }
+        }
+    } break;
+    case Content::Panel: {
+        Rgba background = RandomColour(rng);
+        for (size_t i = 0; i < size_t(size) * size; ++i) {
+            Store(pixels, i, background);
+        }
+        for (int n = 4 + Below(rng, 9); n > 0; --n) {
+            Rgba fill = RandomColour(rng);
+            Rgba border{uint8_t(fill.r / 2), uint8_t(fill.g / 2), uint8_t(fill.b / 2), 255};
+            int w = std::max(4, Below(rng, std::max(1, size / 2))), h = std::max(4, Below(rng, std::max(1, size / 2)));
+            int x0 = Below(rng, std::max(1, size - w)), y0 = Below(rng, std::max(1, size - h));
+            int edge = std::max(1, size / 256);
+            for (int y = y0; y < y0 + h && y < size; ++y) {
+                for (int x = x0; x < x0 + w && x < size; ++x) {
+                    bool onEdge = x < x0 + edge || y < y0 + edge || x >= x0 + w - edge || y >= y0 + h - edge;
+                    Store(pixels, size_t(y) * size + x, onEdge ? border : fill);
+                }
+            }
+        }
+    } break;
+    case Content::Sprite: {
+        std::vector<Rgba> canvas(size_t(size) * size, Rgba{0, 0, 0, 0});
+        for (int n = 3 + Below(rng, 6); n > 0; --n) {
+            Rgba colour = RandomColour(rng);
+            // Centre and radius in units of half a texel.
+            int cx = Below(rng, 2 * size), cy = Below(rng, 2 * size);
+            int radius = 2 * std::max(1, size / 20 + Below(rng, size / 4 + 1));
+            int64_t radius2 = int64_t(radius) * radius;
+            int x0 = std::max(0, (cx - radius) / 2), x1 = std::min(size, (cx + radius) / 2 + 1);
+            int y0 = std::max(0, (cy - radius) / 2), y1 = std::min(size, (cy + radius) / 2 + 1);
+            for (int y = y0; y < y1; ++y) {
+                for (int x = x0; x < x1; ++x) {
+                    int64_t ex = 2 * x + 1 - cx, ey = 2 * y + 1 - cy, d2 = ex * ex + ey * ey;
+                    if (d2 >= radius2) {
+                        continue;
+                    }
+                    // Alpha falls off as (1 - d^2)^2 towards the edge.
+                    int a = int(255 * (radius2 - d2) / radius2);
+                    a = a * a / 255;
+                    // Straight alpha "over", with alphas scaled by 255 until the end.
+                    Rgba &dst = canvas[size_t(y) * size + x];
+                    int below = dst.a * (255 - a), outA = a * 255 + below;
+                    if (outA > 0) {
+                        auto over = [&](uint8_t src, uint8_t under) {
+                            return uint8_t((src * a * 255 + under * below + outA / 2) / outA);
+                        };
+                        dst = {over(colour.r, dst.r), over(colour.g, dst.g), over(colour.b, dst.b),
+                               uint8_t((outA + 127) / 255)};
+                    }
+                }
+            }
+        }
+        for (size_t i = 0; i < canvas.size(); ++i) {
+            Store(pixels, i, canvas[i]);
+        }
+    } break;
+    }
+    return pixels;
+}
+
+// Converts one row of RGBA8 texels into an uncompressed format.
+void StoreRow(gli::format format, uint8_t const *rgba, uint8_t *dst, int width) {
+    for (int x = 0; x < width; ++x, rgba += 4) {
+        switch (format) {
+        case gli::FORMAT_RGBA8_UNORM_PACK8:
+            std::copy(rgba, rgba + 4, dst + x * 4);
+            break;
+        case gli::FORMAT_BGRA8_UNORM_PACK8:
+            dst[x * 4 + 0] = rgba[2];
+            dst[x * 4 + 1] = rgba[1];
+            dst[x * 4 + 2] = rgba[0];
+            dst[x * 4 + 3] = rgba[3];
+            break;
+        case gli::FORMAT_BGR8_UNORM_PACK32:
+            dst[x * 4 + 0] = rgba[2];
+            dst[x * 4 + 1] = rgba[1];
+            dst[x * 4 + 2] = rgba[0];
+            dst[x * 4 + 3] = 255;
+            break;
+        case gli::FORMAT_RG8_UNORM_PACK8:
+            dst[x * 2 + 0] = rgba[0];
+            dst[x * 2 + 1] = rgba[1];
+            break;
+        default:
+            throw std::runtime_error(fmt::format("no texel writer for format {}", int(format)));
+        }
+    }
+}
+
+// The texture data of a single level, block rows compressed in parallel.
+std::vector<uint8_t> Encode(std::vector<uint8_t> const &pixels, int size, gli::format format, float quality,
+                            uint8_t bc7Modes, ThreadPool &pool) {
+    auto header = WriteDdsHeader(format, glm::ivec2(size), 1);
+    auto tex = ParseDdsHeader(header);
+    std::vector<uint8_t> ret(tex->LevelSize(0));
+    size_t rowBytes = size_t(size) * 4;
+
+    if (tex->blockExtent == glm::ivec2(1)) {
+        for (int y = 0; y < size; ++y) {
+            StoreRow(format, pixels.data() + y * rowBytes, ret.data() + y * size * tex->blockSize, size);
+        }
+        return ret;
+    }
+
+    // The encoders are made before any block is compressed, which also builds CMP_Core's lookup tables, and are only
+    // read while compressing, so one of each is shared by all threads.
+    BlockEncoder encoder(format, quality, bc7Modes);
+    // CMP_Core only gives modes 4 to 7 to blocks with alpha, opaque blocks that a set without modes 0 to 3 leaves
+    // unencoded are done again with those modes allowed. The mode counts printed afterwards show the mix that resulted.
+    std::optional<BlockEncoder> opaqueEncoder;
+    if (format == gli::FORMAT_RGBA_BP_UNORM_BLOCK16 && !(bc7Modes & 0x0f)) {
+        opaqueEncoder.emplace(format, quality, uint8_t(bc7Modes | 0x0f));
+    }
+    int blocksWide = (size + 3) / 4, blocksHigh = (size + 3) / 4;
+    TaskGroup group(pool);
+    for (int by = 0; by < blocksHigh; ++by) {
+        group.Run([&, by] {
+            // Blocks are gathered with their edges clamped, for sizes that are not a multiple of four.
+            uint8_t block[64];
+            for (int bx = 0; bx < blocksWide; ++bx) {
+                for (int i = 0; i < 16; ++i) {
+                    int x = std::min(bx * 4 + i % 4, size - 1), y = std::min(by * 4 + i / 4, size - 1);
+                    std::copy_n(pixels.data() + y * rowBytes + x * 4, 4, block + i * 4);
+                }
+                uint8_t *dst = ret.data() + (size_t(by) * blocksWide + bx) * tex->blockSize;
+                encoder.CompressBlock(block, 16, dst);
+                if (opaqueEncoder && dst[0] == 0) {
+                    opaqueEncoder->CompressBlock(block, 16, dst);
+                }
+            }
+        });
+    }
+    group.Wait();
+    return ret;
+}
+
+std::string ModesName(uint8_t modes) {
+    std::string ret;
+    for (int mode = 0; mode < 8; ++mode) {
+        if (modes & (1 << mode)) {
+            ret += char('0' + mode);
+        }
+    }
+    return ret;
+}
+
+// The modes the encoder actually picked, from the unary mode prefix of each block.
+std::string ModeHistogram(std::vector<uint8_t> const &data) {
+    size_t counts[9]{};
+    for (size_t i = 0; i + 16 <= data.size(); i += 16) {
+        int mode = 0;
+        while (mode < 8 && !(data[i] & (1 << mode))) {
+            ++mode;
+        }
+        ++counts[mode];
+    }
+    std::string ret;
+    for (int mode = 0; mode < 9; ++mode) {
+        if (counts[mode]) {
+            ret += fmt::format(" {}:{}", mode < 8 ? std::to_string(mode) : "invalid", counts[mode]);
+        }
+    }
+    return ret;
+}
+
+std::vector<std::string> SplitList(std::string const &value) {
+    std::vector<std::string> ret;
+    for (size_t begin = 0; begin <= value.size();) {
+        size_t end = std::min(value.find(',', begin), value.size());
+        ret.push_back(value.substr(begin, end - begin));
+        begin = end + 1;
+    }
+    return ret;
+}
+
+GenOptions ExtractGenOptions(std::deque<std::string> &args) {
+    GenOptions ret;
+    for (auto I = args.begin(); I != args.end();) {
+        static char const *const withValue[] = {"--size",    "--count",     "--seed",    "--quality",
+                                                "--threads", "--formats",   "--content", "--bc7-modes"};
+        if (std::find(std::begin(withValue), std::end(withValue), *I) == std::end(withValue)) {
+            ++I;
+            continue;
+        }
+        if (I + 1 == args.end()) {
+            throw std::runtime_error(fmt::format("missing value for option {}", *I));
+        }
+        std::string const &option = *I, &value = *(I + 1);
+        if (option == "--size") {
+            ret.size = IntoInt(value);
+            if (ret.size < 1 || ret.size > (1 << 14)) {
+                throw std::runtime_error(fmt::format("invalid size: {}", value));
+            }
+        } else if (option == "--count") {
+            ret.count = IntoInt(value);
+            if (ret.count < 1) {
+                throw std::runtime_error(fmt::format("invalid count: {}", value));
+            }
+        } else if (option == "--seed") {
+            ret.seed = uint32_t(IntoInt(value));
+        } else if (option == "--quality") {
+            char *end = nullptr;
+            ret.quality = std::strtof(value.c_str(), &end);
+            if (value.empty() || *end || !(ret.quality >= 0.0f && ret.quality <= 1.0f)) {
+                throw std::runtime_error(fmt::format("invalid quality, expected 0 to 1: {}", value));
+            }
+        } else if (option == "--threads") {
+            ret.threads = unsigned(std::max(1, IntoInt(value)));
+        } else if (option == "--formats") {
+            ret.formats.clear();
+            for (auto &name : SplitList(value)) {
+                auto I = std::find_if(std::begin(Formats), std::end(Formats), [&](auto &f) { return name == f.name; });
+                if (I == std::end(Formats)) {
+                    throw std::runtime_error(fmt::format("unknown format: {}", name));
+                }
+                ret.formats.push_back(*I);
+            }
+        } else if (option == "--content") {
+            ret.contents.clear();
+            for (auto &name : SplitList(value)) {
+                auto I = std::find(std::begin(ContentNames), std::end(ContentNames), name);
+                if (I == std::end(ContentNames)) {
+                    throw std::runtime_error(fmt::format("unknown content: {}", name));
+                }
+                ret.contents.push_back(Content(I - std::begin(ContentNames)));
+            }
+        } else {
+            ret.bc7Modes.clear();
+            for (auto &set : SplitList(value)) {
+                uint8_t mask = 0;
+                for (char ch : set == "all" ? std::string("01234567") : set) {
+                    if (ch < '0' || ch > '7') {
+                        throw std::runtime_error(fmt::format("invalid BC7 mode set, expected digits 0-7: {}", set));
+                    }
+                    mask |= uint8_t(1 << (ch - '0'));
+                }
+                if (!mask) {
+                    throw std::runtime_error("empty BC7 mode set");
+                }
+                ret.bc7Modes.push_back(mask);
+            }
+        }
+        I = args.erase(I, I + 2);
+    }
+    return ret;
+}
+} // namespace
+
+int main(int argc, char **argv) {
+    std::deque<std::string> args;
+    for (int i = 1; i < argc; ++i) {
+        args.push_back(argv[i]);
+    }
+
+    try {
+        GenOptions options = ExtractGenOptions(args);
+        if (args.size() != 1 || args[0].rfind("--", 0) == 0) {
+            fprintf(stderr,
+                    "%s [--size N] [--count N] [--seed N] [--formats NAME,...] [--content NAME,...] "
+                    "[--bc7-modes MODES,...] [--quality Q] [--threads N] OUT_DIR\n",
+                    argv[0]);
+            fprintf(stderr, "formats:");
+            for (auto &format : Formats) {
+                fprintf(stderr, " %s", format.name);
+            }
+            fprintf(stderr, "\ncontent:");
+            for (auto name : ContentNames) {
+                fprintf(stderr, " %s", name);
+            }
+            fprintf(stderr, "\nBC7 mode sets are digits, such as 6 or 0123, or all\n");
+            return 1;
+        }
+        std::filesystem::path outDir = args[0];
+        std::filesystem::create_directories(outDir);
+
+        ThreadPool pool(options.threads);
+        for (auto content : options.contents) {
+            for (int index = 0; index < options.count; ++index) {
+                // Seeded by what is drawn rather than by the order of generation, so that a texture does not change
+                // with the other options.
+                std::seed_seq seq{options.seed, uint32_t(content), uint32_t(index), uint32_t(options.size)};
+                std::mt19937 rng(seq);
+                auto pixels = Draw(content, options.size, rng);
+                for (auto &format : options.formats) {
+                    bool isBc7 = format.format == gli::FORMAT_RGBA_BP_UNORM_BLOCK16;
+                    for (uint8_t modes : isBc7 ? options.bc7Modes : std::vector<uint8_t>{0xff}) {
+                        std::string name =
+                            fmt::format("{}_{:03}_{}", ContentNames[int(content)], index, format.name);
+                        if (isBc7 && modes != 0xff) {
+                            name += "_m" + ModesName(modes);
+                        }
+                        auto data = Encode(pixels, options.size, format.format, options.quality, modes, pool);
+                        auto file = WriteDdsHeader(format.format, glm::ivec2(options.size), 1);
+                        file.insert(file.end(), data.begin(), data.end());
+                        auto path = (outDir / (name + ".dds")).string();
+                        WriteFile(path, file);
+                        std::string modesUsed = isBc7 ? ", modes" + ModeHistogram(data) : "";
+                        fprintf(stderr, "%s%s\n", path.c_str(), modesUsed.c_str());
+                    }
+                }
+            }
+        }
+        return 0;
+    } catch (std::exception &e) {
+        fprintf(stderr, "error: %s\n", e.what());
+    }
+    return 1;
+}
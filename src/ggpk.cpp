@@ -0,0 +1,365 @@
+#include "ggpk.h"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <unordered_set>
+
+#include <fmt/core.h>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "convert.h"
+#include "stats.h"
+
+namespace fs = std::filesystem;
+
+// Bump when the file layout changes, older indices are then ignored and the archive is walked again.
+static char const IndexHeader[] = "process-image-ggpk-index 1";
+
+bool IsGgpkPath(std::string_view path) { return path.substr(0, GgpkPrefix.size()) == GgpkPrefix; }
+
+std::string_view GgpkEntryPath(std::string_view path) {
+    return IsGgpkPath(path) ? path.substr(GgpkPrefix.size()) : path;
+}
+
+// Paths as they are looked up, lower case with forward slashes and no leading slash.
+static std::string LookupKey(std::string_view path) {
+    std::string ret(path);
+    for (auto &ch : ret) {
+        ch = ch == '\\' ? '/' : static_cast<char>(std::tolower(static_cast<unsigned char>(ch)));
+    }
+    ret.erase(0, ret.find_first_not_of('/'));
+    return ret;
+}
+
+static void AppendUtf8(std::string &out, uint32_t cp) {
+    if (cp < 0x80) {
+        out += static_cast<char>(cp);
+    } else if (cp < 0x800) {
+        out += static_cast<char>(0xC0 | (cp >> 6));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        out += static_cast<char>(0xE0 | (cp >> 12));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (cp >> 18));
+        out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+}
+
+GgpkArchive::GgpkArchive(fs::path const &path) {
+    Map(path);
+    try {
+        mtime = fs::last_write_time(path).time_since_epoch().count();
+        auto indexPath = path;
+        indexPath += ".index";
+        if (!LoadIndex(indexPath)) {
+            entries.clear();
+            Walk();
+            try {
+                SaveIndex(indexPath);
+            } catch (std::exception &e) {
+                // Only later runs suffer from not having an index, this one can carry on.
+                fprintf(stderr, "warning: %s\n", e.what());
+            }
+        }
+        byPath.reserve(entries.size());
+        for (size_t i = 0; i < entries.size(); ++i) {
+            byPath.emplace(LookupKey(entries[i].path), i);
+        }
+    } catch (...) {
+        Unmap();
+        throw;
+    }
+}
+
+GgpkArchive::~GgpkArchive() { Unmap(); }
+
+void GgpkArchive::Map(fs::path const &path) {
+    auto fail = [&] { throw std::runtime_error(fmt::format("could not map archive: {}", path.string())); };
+#ifdef _WIN32
+    HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        fail();
+    }
+    fileHandle = file;
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+        Unmap();
+        fail();
+    }
+    size = fileSize.QuadPart;
+    mappingHandle = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mappingHandle) {
+        Unmap();
+        fail();
+    }
+    base = static_cast<uint8_t const *>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+    if (!base) {
+        Unmap();
+        fail();
+    }
+#else
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        fail();
+    }
+    struct stat st;
+    void *mapping = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        fail();
+    }
+    base = static_cast<uint8_t const *>(mapping);
+    size = st.st_size;
+#endif
+}
+
+void GgpkArchive::Unmap() {
+#ifdef _WIN32
+    if (base) {
+        UnmapViewOfFile(base);
+    }
+    if (mappingHandle) {
+        CloseHandle(mappingHandle);
+    }
+    if (fileHandle) {
+        CloseHandle(fileHandle);
+    }
+    mappingHandle = fileHandle = nullptr;
+#else
+    if (base) {
+        munmap(const_cast<uint8_t *>(base), size);
+    }
+#endif
+    base = nullptr;
+}
+
+// The archive is a tree of records, each starting with its length, which includes the length itself, and a four
+// character tag. The GGPK record at the start points at the root PDIR, whose entries point at further PDIR and FILE
+// records. Names are NUL terminated UTF-16, or UTF-32 from version 4 on, and both directory and file records carry a
+// 32 byte hash ahead of the name.
+void GgpkArchive::Walk() {
+    auto fail = [](char const *what, uint64_t offset) {
+        throw std::runtime_error(fmt::format("malformed archive, {} at offset {}", what, offset));
+    };
+    auto need = [&](uint64_t offset, uint64_t count) {
+        if (offset > size || count > size - offset) {
+            fail("truncated record", offset);
+        }
+    };
+    auto read32 = [&](uint64_t offset) {
+        need(offset, 4);
+        uint32_t ret;
+        memcpy(&ret, base + offset, sizeof(ret));
+        return ret;
+    };
+    auto read64 = [&](uint64_t offset) {
+        need(offset, 8);
+        uint64_t ret;
+        memcpy(&ret, base + offset, sizeof(ret));
+        return ret;
+    };
+    auto tagAt = [&](uint64_t offset) {
+        need(offset, 8);
+        return std::string_view(reinterpret_cast<char const *>(base + offset + 4), 4);
+    };
+
+    if (tagAt(0) != "GGPK") {
+        throw std::runtime_error("not a GGPK archive");
+    }
+    uint32_t version = read32(8);
+    uint64_t rootOffset = read64(12);
+    uint64_t charSize = version >= 4 ? 4 : 2;
+
+    auto readName = [&](uint64_t offset, uint32_t length) {
+        need(offset, length * charSize);
+        std::string ret;
+        for (uint32_t i = 0; i < length; ++i) {
+            uint32_t cp = charSize == 4 ? read32(offset + i * 4) : base[offset + i * 2] | base[offset + i * 2 + 1] << 8;
+            if (cp == 0) {
+                break;
+            }
+            if (charSize == 2 && cp >= 0xD800 && cp < 0xDC00 && i + 1 < length) {
+                uint32_t low = base[offset + i * 2 + 2] | base[offset + i * 2 + 3] << 8;
+                if (low >= 0xDC00 && low < 0xE000) {
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                    ++i;
+                }
+            }
+            AppendUtf8(ret, cp);
+        }
+        return ret;
+    };
+    auto join = [](std::string const &dir, std::string const &name) { return dir.empty() ? name : dir + "/" + name; };
+
+    // Depth first from the root, remembering visited records so that a damaged archive cannot send the walk in circles.
+    std::vector<std::pair<uint64_t, std::string>> pending{{rootOffset, ""}};
+    std::unordered_set<uint64_t> seen{rootOffset};
+    while (!pending.empty()) {
+        auto [offset, dir] = std::move(pending.back());
+        pending.pop_back();
+        uint64_t recordEnd = offset + read32(offset);
+        need(offset, recordEnd - offset);
+        auto tag = tagAt(offset);
+        if (tag == "PDIR") {
+            uint32_t nameLength = read32(offset + 8);
+            uint32_t count = read32(offset + 12);
+            uint64_t namePos = offset + 16 + 32;
+            std::string path = join(dir, readName(namePos, nameLength));
+            uint64_t entryPos = namePos + nameLength * charSize;
+            // Each entry is the hash of the child's name followed by the offset of its record.
+            if (entryPos + count * uint64_t(12) > recordEnd) {
+                fail("directory entries past end of record", offset);
+            }
+            for (uint32_t i = 0; i < count; ++i) {
+                uint64_t child = read64(entryPos + i * uint64_t(12) + 4);
+                if (seen.insert(child).second) {
+                    pending.emplace_back(child, path);
+                }
+            }
+        } else if (tag == "FILE") {
+            uint32_t nameLength = read32(offset + 8);
+            uint64_t namePos = offset + 12 + 32;
+            std::string name = readName(namePos, nameLength);
+            uint64_t dataPos = namePos + nameLength * charSize;
+            if (dataPos > recordEnd) {
+                fail("file name past end of record", offset);
+            }
+            entries.push_back(GgpkEntry{join(dir, name), dataPos, recordEnd - dataPos});
+        } else {
+            fail("unexpected record", offset);
+        }
+    }
+}
+
+// Header line, then the archive's size and time stamp, then "offset size path" for every file. Anything that does
+// not match the archive is ignored, the index being no more than a cache.
+bool GgpkArchive::LoadIndex(fs::path const &indexPath) {
+    std::vector<uint8_t> data;
+    try {
+        data = ReadFile(indexPath.string());
+    } catch (std::exception &) {
+        return false;
+    }
+    std::string_view text(reinterpret_cast<char const *>(data.data()), data.size());
+    auto nextLine = [&](std::string_view &line) {
+        size_t end = text.find('\n');
+        if (end == std::string_view::npos) {
+            return false;
+        }
+        line = text.substr(0, end);
+        text.remove_prefix(end + 1);
+        return true;
+    };
+    auto nextNumber = [](std::string_view &line, auto &value, int base) {
+        auto [ptr, ec] = std::from_chars(line.data(), line.data() + line.size(), value, base);
+        if (ec != std::errc() || ptr == line.data() + line.size() || *ptr != ' ') {
+            return false;
+        }
+        line.remove_prefix(ptr - line.data() + 1);
+        return true;
+    };
+
+    std::string_view line;
+    uint64_t indexSize;
+    int64_t indexMtime;
+    if (!nextLine(line) || line != IndexHeader || !nextLine(line)) {
+        return false;
+    }
+    if (!nextNumber(line, indexSize, 10) || !nextNumber(line, indexMtime, 10) || indexSize != size ||
+        indexMtime != mtime) {
+        return false;
+    }
+    while (nextLine(line)) {
+        GgpkEntry entry;
+        if (!nextNumber(line, entry.offset, 16) || !nextNumber(line, entry.size, 10) || line.empty() ||
+            entry.offset > size || entry.size > size - entry.offset) {
+            entries.clear();
+            return false;
+        }
+        entry.path = line;
+        entries.push_back(std::move(entry));
+    }
+    return true;
+}
+
+void GgpkArchive::SaveIndex(fs::path const &indexPath) const {
+    // Write next to the destination and rename over it, so that a reader never sees half an index.
+    auto tmpPath = indexPath;
+    tmpPath += ".tmp";
+    {
+        std::ofstream os(tmpPath, std::ios::trunc | std::ios::binary);
+        os << IndexHeader << '\n' << size << ' ' << mtime << " \n";
+        for (auto &entry : entries) {
+            os << fmt::format("{:x} {} {}\n", entry.offset, entry.size, entry.path);
+        }
+        if (!os.flush()) {
+            throw std::runtime_error(fmt::format("could not write archive index: {}", tmpPath.string()));
+        }
+    }
+    fs::rename(tmpPath, indexPath);
+}
+
+GgpkEntry const *GgpkArchive::Find(std::string_view path) const {
+    auto I = byPath.find(LookupKey(path));
+    return I != byPath.end() ? &entries[I->second] : nullptr;
+}
+
+gsl::span<uint8_t const> GgpkArchive::Read(std::string_view path) const {
+    auto const *entry = Find(path);
+    if (!entry) {
+        throw std::runtime_error(fmt::format("file not in archive: {}", path));
+    }
+    return gsl::make_span(base + entry->offset, entry->size);
+}
+
+std::vector<GgpkEntry const *> GgpkArchive::List(std::string_view dir) const {
+    std::string prefix = LookupKey(dir);
+    if (!prefix.empty() && prefix.back() != '/') {
+        prefix += '/';
+    }
+    std::vector<GgpkEntry const *> ret;
+    for (auto &[key, index] : byPath) {
+        if (key.compare(0, prefix.size(), prefix) == 0) {
+            ret.push_back(&entries[index]);
+        }
+    }
+    return ret;
+}
+
+gsl::span<uint8_t const> ReadSource(std::string const &path, GgpkArchive const *archive,
+                                    std::vector<uint8_t> &storage) {
+    if (IsGgpkPath(path)) {
+        if (!archive) {
+            throw std::runtime_error(fmt::format("no archive given with --ggpk for: {}", path));
+        }
+        PhaseTimer timer(Phase::Read);
+        auto ret = archive->Read(GgpkEntryPath(path));
+        CountBytesRead(ret.size());
+        return ret;
+    }
+    storage = ReadFile(path);
+    return storage;
+}
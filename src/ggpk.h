@@ -0,0 +1,70 @@
+#ifndef GGPK_H
+#define GGPK_H
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <gsl/span>
+
+// Source paths of this form name a file inside the archive given with --ggpk, "ggpk:Art/Textures/foo.dds".
+constexpr std::string_view GgpkPrefix = "ggpk:";
+
+bool IsGgpkPath(std::string_view path);
+// The archive path with the prefix removed.
+std::string_view GgpkEntryPath(std::string_view path);
+
+struct GgpkEntry {
+    std::string path;
+    // Where the contents of the file start in the archive, and how many bytes they are.
+    uint64_t offset{};
+    uint64_t size{};
+};
+
+// A Content.ggpk mapped into memory, with an index from file path to contents. Walking the directory records of a
+// whole archive touches a lot of it, so the index is saved next to the archive and reused for as long as the archive's
+// size and time stamp stay the same. Lookups ignore case and the direction of slashes, as the game does.
+class GgpkArchive {
+  public:
+    explicit GgpkArchive(std::filesystem::path const &path);
+    ~GgpkArchive();
+    GgpkArchive(GgpkArchive const &) = delete;
+    GgpkArchive &operator=(GgpkArchive const &) = delete;
+
+    GgpkEntry const *Find(std::string_view path) const;
+    // The contents of a file, pointing into the mapping. Throws for files that are not in the archive.
+    gsl::span<uint8_t const> Read(std::string_view path) const;
+    // Files below a directory, all files for an empty one, in no particular order.
+    std::vector<GgpkEntry const *> List(std::string_view dir) const;
+
+    // Time stamp of the archive, which changes whenever the game patches any file in it.
+    int64_t Mtime() const { return mtime; }
+
+  private:
+    void Map(std::filesystem::path const &path);
+    void Unmap();
+    void Walk();
+    bool LoadIndex(std::filesystem::path const &indexPath);
+    void SaveIndex(std::filesystem::path const &indexPath) const;
+
+    uint8_t const *base{};
+    uint64_t size{};
+    int64_t mtime{};
+#ifdef _WIN32
+    void *fileHandle{};
+    void *mappingHandle{};
+#endif
+
+    std::vector<GgpkEntry> entries;
+    std::unordered_map<std::string, size_t> byPath;
+};
+
+// The bytes of a source file: read from disk into storage, or a view into the archive for ggpk paths, which are an
+// error without one.
+gsl::span<uint8_t const> ReadSource(std::string const &path, GgpkArchive const *archive,
+                                    std::vector<uint8_t> &storage);
+
+#endif // GGPK_H
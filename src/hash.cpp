@@ -0,0 +1,86 @@
+#include "hash.h"
+
+#include <cstring>
+
+namespace {
+constexpr uint64_t Prime1 = 0x9E3779B185EBCA87ull;
+constexpr uint64_t Prime2 = 0xC2B2AE3D27D4EB4Full;
+constexpr uint64_t Prime3 = 0x165667B19E3779F9ull;
+constexpr uint64_t Prime4 = 0x85EBCA77C2B2AE63ull;
+constexpr uint64_t Prime5 = 0x27D4EB2F165667C5ull;
+
+uint64_t Rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+// Inputs are read as little-endian, which is what every platform we build for is.
+uint64_t Read64(uint8_t const *p) {
+    uint64_t ret;
+    memcpy(&ret, p, sizeof(ret));
+    return ret;
+}
+
+uint32_t Read32(uint8_t const *p) {
+    uint32_t ret;
+    memcpy(&ret, p, sizeof(ret));
+    return ret;
+}
+
+uint64_t Round(uint64_t acc, uint64_t input) {
+    acc += input * Prime2;
+    acc = Rotl(acc, 31);
+    return acc * Prime1;
+}
+
+uint64_t MergeRound(uint64_t acc, uint64_t val) {
+    acc ^= Round(0, val);
+    return acc * Prime1 + Prime4;
+}
+} // namespace
+
+uint64_t HashBytes(void const *data, size_t size, uint64_t seed) {
+    auto *p = static_cast<uint8_t const *>(data);
+    auto *end = p + size;
+    uint64_t h64;
+
+    if (size >= 32) {
+        uint64_t v1 = seed + Prime1 + Prime2;
+        uint64_t v2 = seed + Prime2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - Prime1;
+        do {
+            v1 = Round(v1, Read64(p));
+            v2 = Round(v2, Read64(p + 8));
+            v3 = Round(v3, Read64(p + 16));
+            v4 = Round(v4, Read64(p + 24));
+            p += 32;
+        } while (end - p >= 32);
+        h64 = Rotl(v1, 1) + Rotl(v2, 7) + Rotl(v3, 12) + Rotl(v4, 18);
+        h64 = MergeRound(h64, v1);
+        h64 = MergeRound(h64, v2);
+        h64 = MergeRound(h64, v3);
+        h64 = MergeRound(h64, v4);
+    } else {
+        h64 = seed + Prime5;
+    }
+    h64 += static_cast<uint64_t>(size);
+
+    for (; end - p >= 8; p += 8) {
+        h64 ^= Round(0, Read64(p));
+        h64 = Rotl(h64, 27) * Prime1 + Prime4;
+    }
+    if (end - p >= 4) {
+        h64 ^= static_cast<uint64_t>(Read32(p)) * Prime1;
+        h64 = Rotl(h64, 23) * Prime2 + Prime3;
+        p += 4;
+    }
+    for (; p < end; ++p) {
+        h64 ^= *p * Prime5;
+        h64 = Rotl(h64, 11) * Prime1;
+    }
+
+    h64 ^= h64 >> 33;
+    h64 *= Prime2;
+    h64 ^= h64 >> 29;
+    h64 *= Prime3;
+    h64 ^= h64 >> 32;
+    return h64;
+}
@@ -0,0 +1,10 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <cstddef>
+#include <cstdint>
+
+// 64-bit non-cryptographic hash of a byte range, compatible with XXH64.
+uint64_t HashBytes(void const *data, size_t size, uint64_t seed = 0);
+
+#endif // HASH_H
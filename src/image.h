@@ -0,0 +1,56 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <cstdint>
+
+#include <glm/glm.hpp>
+#include <gsl/span>
+
+#include "pixel_buffer.h"
+
+struct Rect {
+    glm::ivec2 origin;
+    glm::ivec2 size;
+};
+
+// Pixels start out uninitialised, whoever creates an image writes every one of them.
+struct Image {
+    Image(glm::ivec2 extent, int components)
+        : extent(extent), components(components), data(size_t(extent.x) * extent.y * components) {}
+
+    uint8_t *GetPixel(glm::ivec2 pixelCoord) {
+        int idx = pixelCoord.x + extent.x * pixelCoord.y;
+        return data.data() + components * idx;
+    }
+
+    uint8_t const *GetPixel(glm::ivec2 pixelCoord) const {
+        int idx = pixelCoord.x + extent.x * pixelCoord.y;
+        return data.data() + components * idx;
+    }
+
+    int GetStride() const { return extent.x * components; }
+
+    glm::ivec2 extent{};
+    int components{};
+    PixelBuffer data;
+};
+
+struct ImageRef {
+    ImageRef(glm::ivec2 extent, int comp, gsl::span<uint8_t const> data)
+        : extent(extent), components(comp), data(data) {}
+
+    ImageRef(Image const &img) : extent(img.extent), components(img.components), data(img.data) {}
+
+    uint8_t const *GetPixel(glm::ivec2 pixelCoord) const {
+        int idx = pixelCoord.x + extent.x * pixelCoord.y;
+        return data.data() + components * idx;
+    }
+
+    int GetStride() const { return extent.x * components; }
+
+    glm::ivec2 extent{};
+    int components{};
+    gsl::span<uint8_t const> data;
+};
+
+#endif // IMAGE_H
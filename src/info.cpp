@@ -0,0 +1,114 @@
+#include "info.h"
+
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+
+#include <fmt/core.h>
+
+#include "convert.h"
+#include "gli_format_names.h"
+
+InfoFormat ParseInfoFormat(std::string_view name) {
+    if (name == "jsonl") {
+        return InfoFormat::Jsonl;
+    }
+    if (name == "csv") {
+        return InfoFormat::Csv;
+    }
+    throw std::runtime_error(fmt::format("unknown info format, expected jsonl or csv: {}", name));
+}
+
+TextureInfo ReadTextureInfo(std::string const &path, PayloadResolver &resolver, GgpkArchive const *archive) {
+    TextureInfo ret;
+    ret.path = path;
+    std::vector<uint8_t> storage;
+    uint8_t headerBuf[DdsMaxHeaderSize];
+    gsl::span<uint8_t const> header;
+    if (IsGgpkPath(path)) {
+        // Files in an archive are mapped already, the header is simply the start of them.
+        header = ReadSource(path, archive, storage);
+        ret.fileSize = header.size();
+    } else {
+        std::unique_ptr<FILE, decltype(&fclose)> fh(fopen(path.c_str(), "rb"), &fclose);
+        if (!fh) {
+            throw std::runtime_error(fmt::format("could not open file: {}", path));
+        }
+        size_t headerSize = fread(headerBuf, 1, sizeof(headerBuf), fh.get());
+        long size = -1;
+        if (!ferror(fh.get()) && fseek(fh.get(), 0, SEEK_END) == 0) {
+            size = ftell(fh.get());
+        }
+        if (size < 0) {
+            throw std::runtime_error(fmt::format("could not read file: {}", path));
+        }
+        ret.fileSize = size;
+        header = gsl::make_span(headerBuf, headerSize);
+    }
+
+    if (auto tex = ParseDdsHeader(header)) {
+        ret.tex = *tex;
+    } else {
+        auto data = ReadSource(path, archive, storage);
+        PayloadScratch scratch;
+        ret.tex = LoadTexture(resolver.Resolve(data, scratch, path), path).tex;
+        ret.tex.data = {};
+    }
+    return ret;
+}
+
+std::string InfoCsvHeader() { return "path,width,height,format,levels,layers,faces,file_size,data_size\n"; }
+
+std::string JsonString(std::string_view s) {
+    std::string ret = "\"";
+    for (char ch : s) {
+        switch (ch) {
+        case '"':
+            ret += "\\\"";
+            break;
+        case '\\':
+            ret += "\\\\";
+            break;
+        case '\n':
+            ret += "\\n";
+            break;
+        case '\t':
+            ret += "\\t";
+            break;
+        default:
+            if (static_cast<unsigned char>(ch) < 0x20) {
+                ret += fmt::format("\\u{:04x}", static_cast<int>(ch));
+            } else {
+                ret += ch;
+            }
+        }
+    }
+    return ret + "\"";
+}
+
+static std::string CsvField(std::string_view s) {
+    if (s.find_first_of(",\"\r\n") == std::string_view::npos) {
+        return std::string(s);
+    }
+    std::string ret = "\"";
+    for (char ch : s) {
+        ret += ch;
+        if (ch == '"') {
+            ret += '"';
+        }
+    }
+    return ret + "\"";
+}
+
+std::string FormatTextureInfo(TextureInfo const &info, InfoFormat format) {
+    auto &tex = info.tex;
+    auto formatName = GliFormatName(tex.format);
+    if (format == InfoFormat::Csv) {
+        return fmt::format("{},{},{},{},{},{},{},{},{}\n", CsvField(info.path), tex.extent.x, tex.extent.y, formatName,
+                           tex.levels, tex.layers, tex.faces, info.fileSize, tex.DataSize());
+    }
+    return fmt::format("{{\"path\":{},\"width\":{},\"height\":{},\"format\":\"{}\",\"levels\":{},\"layers\":{},"
+                       "\"faces\":{},\"file_size\":{},\"data_size\":{}}}\n",
+                       JsonString(info.path), tex.extent.x, tex.extent.y, formatName, tex.levels, tex.layers,
+                       tex.faces, info.fileSize, tex.DataSize());
+}
@@ -0,0 +1,40 @@
+#ifndef INFO_H
+#define INFO_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "dds.h"
+#include "ggpk.h"
+#include "payload.h"
+
+enum class InfoFormat {
+    Jsonl,
+    Csv,
+};
+
+// Parses "jsonl" or "csv".
+InfoFormat ParseInfoFormat(std::string_view name);
+
+struct TextureInfo {
+    std::string path;
+    uintmax_t fileSize{};
+    // Only the header fields are filled in, the data span is empty.
+    DdsTexture tex;
+};
+
+// Describes a texture from the header at the start of the file. Compressed and redirected files, and those in formats
+// that the native parser does not know, are read whole. Paths starting with "ggpk:" are looked up in the archive.
+TextureInfo ReadTextureInfo(std::string const &path, PayloadResolver &resolver, GgpkArchive const *archive);
+
+// A quoted and escaped JSON string.
+std::string JsonString(std::string_view s);
+
+// Column names for CSV output, with a trailing newline.
+std::string InfoCsvHeader();
+
+// One JSON object or CSV row, with a trailing newline.
+std::string FormatTextureInfo(TextureInfo const &info, InfoFormat format);
+
+#endif // INFO_H
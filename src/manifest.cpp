@@ -0,0 +1,59 @@
+#include "manifest.h"
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include <fmt/core.h>
+
+// Bump when the file layout changes, older manifests are then ignored and everything is converted again.
+static char const ManifestHeader[] = "process-image-manifest 2";
+
+Manifest Manifest::Load(std::filesystem::path const &path) {
+    Manifest ret;
+    std::ifstream is(path);
+    if (!is) {
+        return ret;
+    }
+
+    std::string line;
+    if (!std::getline(is, line) || line != ManifestHeader) {
+        return ret;
+    }
+    // size mtime source-hash options-hash output-hash redirect path, the path being last as it may contain spaces
+    while (std::getline(is, line)) {
+        std::istringstream fields(line);
+        ManifestEntry entry;
+        std::string key;
+        fields >> entry.size >> entry.mtime >> std::hex >> entry.sourceHash >> entry.optionsHash >> entry.outputHash >>
+            entry.redirect;
+        if (!fields || fields.get() != ' ' || !std::getline(fields, key) || key.empty()) {
+            throw std::runtime_error(fmt::format("malformed manifest line in {}: {}", path.string(), line));
+        }
+        ret.entries[key] = entry;
+    }
+    return ret;
+}
+
+void Manifest::Save(std::filesystem::path const &path) const {
+    // Write next to the destination and rename over it, so an interrupted run leaves the old manifest intact.
+    auto tmpPath = path;
+    tmpPath += ".tmp";
+    {
+        std::ofstream os(tmpPath, std::ios::trunc);
+        os << ManifestHeader << '\n';
+        for (auto &[key, entry] : entries) {
+            os << fmt::format("{} {} {:016x} {:016x} {:016x} {:d} {}\n", entry.size, entry.mtime, entry.sourceHash,
+                              entry.optionsHash, entry.outputHash, entry.redirect, key);
+        }
+        if (!os.flush()) {
+            throw std::runtime_error(fmt::format("could not write manifest: {}", tmpPath.string()));
+        }
+    }
+    std::filesystem::rename(tmpPath, path);
+}
+
+ManifestEntry const *Manifest::Find(std::string const &key) const {
+    auto I = entries.find(key);
+    return I != entries.end() ? &I->second : nullptr;
+}
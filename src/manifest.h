@@ -0,0 +1,36 @@
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <string>
+
+// What was known about a source file when it was last converted.
+struct ManifestEntry {
+    uintmax_t size{};
+    int64_t mtime{};
+    uint64_t sourceHash{};
+    uint64_t optionsHash{};
+    uint64_t outputHash{};
+    // Redirects are never skipped by size and time stamp, which say nothing about the texture they point at. Their
+    // source hash covers that texture as well as the redirect itself.
+    bool redirect{};
+};
+
+// Record of the conversions done into an output tree, keyed by source path relative to the source tree, so that
+// later runs can skip files whose contents and conversion options have not changed.
+class Manifest {
+  public:
+    // A missing file gives an empty manifest, a malformed one is an error.
+    static Manifest Load(std::filesystem::path const &path);
+    void Save(std::filesystem::path const &path) const;
+
+    ManifestEntry const *Find(std::string const &key) const;
+    void Set(std::string const &key, ManifestEntry const &entry) { entries[key] = entry; }
+
+  private:
+    std::map<std::string, ManifestEntry> entries;
+};
+
+#endif // MANIFEST_H
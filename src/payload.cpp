@@ -0,0 +1,206 @@
+#include "payload.h"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <stdexcept>
+
+#include <fmt/core.h>
+
+#ifdef PROCESS_IMAGE_BROTLI
+#include <brotli/decode.h>
+#endif
+
+#include "convert.h"
+#include "hash.h"
+#include "stats.h"
+
+// Redirects pointing at further redirects are followed this many times before giving up on a cycle.
+static constexpr int MaxRedirectDepth = 8;
+
+// Plausibility limit for the size prefix of compressed files, so that random data is not mistaken for one.
+static constexpr uint32_t MaxPayloadSize = 1u << 30;
+
+// Loaded redirect targets are kept up to this many bytes, least recently used ones going first. Files still being
+// converted keep theirs alive regardless.
+static constexpr size_t MaxCachedTargetBytes = size_t(256) << 20;
+
+// Smallest output buffer a compressed file starts with before it grows.
+static constexpr size_t InitialUnpackSize = 1u << 20;
+
+PayloadKind DetectPayload(gsl::span<uint8_t const> data) {
+    if (data.size() >= 4 && memcmp(data.data(), "DDS ", 4) == 0) {
+        return PayloadKind::Plain;
+    }
+    if (!data.empty() && data[0] == '*') {
+        return PayloadKind::Redirect;
+    }
+    if (data.size() > 4) {
+        uint32_t size;
+        memcpy(&size, data.data(), sizeof(size));
+        if (size != 0 && size <= MaxPayloadSize) {
+            return PayloadKind::Compressed;
+        }
+    }
+    return PayloadKind::Plain;
+}
+
+std::string RedirectTarget(gsl::span<uint8_t const> data) {
+    std::string ret(reinterpret_cast<char const *>(data.data()) + 1, data.size() - 1);
+    while (!ret.empty() && (ret.back() == '\0' || ret.back() == '\r' || ret.back() == '\n' || ret.back() == ' ')) {
+        ret.pop_back();
+    }
+    for (auto &ch : ret) {
+        if (ch == '\\') {
+            ch = '/';
+        }
+    }
+    ret.erase(0, ret.find_first_not_of('/'));
+    return ret;
+}
+
+PixelBuffer DecompressPayload(gsl::span<uint8_t const> data, std::string const &name) {
+    PhaseTimer timer(Phase::Unpack);
+#ifdef PROCESS_IMAGE_BROTLI
+    uint32_t size;
+    memcpy(&size, data.data(), sizeof(size));
+
+    // The size prefix is only trusted as an upper bound. Output starts at a few times the compressed size and grows as
+    // the stream fills it, so that a file that merely looks like it has a size prefix fails after a little work rather
+    // than after allocating and writing whatever size its first bytes happen to claim.
+    std::unique_ptr<BrotliDecoderState, decltype(&BrotliDecoderDestroyInstance)> state(
+        BrotliDecoderCreateInstance(nullptr, nullptr, nullptr), &BrotliDecoderDestroyInstance);
+    if (!state) {
+        throw std::bad_alloc();
+    }
+    size_t availableIn = data.size() - 4;
+    uint8_t const *nextIn = data.data() + 4;
+    PixelBuffer out(std::min<size_t>(size, std::max<size_t>(4 * data.size(), InitialUnpackSize)));
+    size_t produced = 0;
+    while (true) {
+        size_t availableOut = out.size() - produced;
+        uint8_t *nextOut = out.data() + produced;
+        auto result =
+            BrotliDecoderDecompressStream(state.get(), &availableIn, &nextIn, &availableOut, &nextOut, nullptr);
+        produced = nextOut - out.data();
+        if (result == BROTLI_DECODER_RESULT_SUCCESS && produced == size) {
+            return out;
+        }
+        if (result != BROTLI_DECODER_RESULT_NEEDS_MORE_OUTPUT || out.size() == size) {
+            throw std::runtime_error(fmt::format("could not decompress texture: {}", name));
+        }
+        PixelBuffer grown(std::min<size_t>(size, 2 * out.size()));
+        memcpy(grown.data(), out.data(), produced);
+        out = std::move(grown);
+    }
+#else
+    throw std::runtime_error(fmt::format("compressed texture, but built without brotli support: {}", name));
+#endif
+}
+
+gsl::span<uint8_t const> PayloadResolver::Resolve(gsl::span<uint8_t const> data, PayloadScratch &scratch,
+                                                  std::string const &name) {
+    switch (DetectPayload(data)) {
+    case PayloadKind::Plain:
+        return data;
+    case PayloadKind::Compressed:
+        scratch.unpacked = DecompressPayload(data, name);
+        return gsl::span<uint8_t const>(scratch.unpacked.data(), scratch.unpacked.size());
+    case PayloadKind::Redirect: {
+        // The cache may drop the target at any time, the scratch keeps it alive for the caller.
+        Target target = LoadTarget(RedirectTarget(data));
+        scratch.target = target;
+        return target->data;
+    }
+    }
+    return data;
+}
+
+uint64_t PayloadResolver::RedirectHash(gsl::span<uint8_t const> data) {
+    std::string path = RedirectTarget(data);
+    {
+        std::lock_guard lk(mutex);
+        auto I = targets.find(path);
+        if (I != targets.end() && I->second.hashed) {
+            return I->second.hash;
+        }
+    }
+    return LoadTarget(path)->hash;
+}
+
+PayloadResolver::Target PayloadResolver::LoadTarget(std::string const &path) {
+    // The first file to ask for a target that is not cached loads it, everyone else waits for that load.
+    std::promise<Target> promise;
+    std::shared_future<Target> future;
+    bool load = false;
+    {
+        std::lock_guard lk(mutex);
+        auto &entry = targets[path];
+        if (!entry.future.valid()) {
+            entry.future = promise.get_future().share();
+            load = true;
+        } else if (entry.cached) {
+            recent.splice(recent.begin(), recent, entry.recent);
+        }
+        future = entry.future;
+    }
+    if (!load) {
+        return future.get();
+    }
+
+    auto ret = std::make_shared<TargetData>();
+    try {
+        // Chains of redirects are followed here rather than through the cache, so that a cycle cannot wait on itself.
+        std::string current = path;
+        std::vector<uint8_t> storage;
+        auto read = [&]() -> gsl::span<uint8_t const> {
+            if (archive) {
+                return archive->Read(current);
+            }
+            storage = ReadFile((root / current).string());
+            return storage;
+        };
+        auto data = read();
+        for (int depth = 1; DetectPayload(data) == PayloadKind::Redirect; ++depth) {
+            if (depth == MaxRedirectDepth) {
+                throw std::runtime_error(fmt::format("too many redirects: {}", path));
+            }
+            current = RedirectTarget(data);
+            data = read();
+        }
+        if (DetectPayload(data) == PayloadKind::Compressed) {
+            ret->unpacked = DecompressPayload(data, current);
+            ret->data = gsl::span<uint8_t const>(ret->unpacked.data(), ret->unpacked.size());
+        } else if (archive) {
+            ret->data = data;
+        } else {
+            ret->file = std::move(storage);
+            ret->data = ret->file;
+        }
+        ret->hash = HashBytes(ret->data.data(), ret->data.size());
+    } catch (...) {
+        // Failures stay cached, so that every file pointing at a broken target gets the same error straight away.
+        promise.set_exception(std::current_exception());
+        return future.get();
+    }
+    promise.set_value(ret);
+
+    std::lock_guard lk(mutex);
+    auto &entry = targets[path];
+    entry.hashed = true;
+    entry.hash = ret->hash;
+    entry.bytes = ret->file.size() + ret->unpacked.size();
+    entry.cached = true;
+    entry.recent = recent.insert(recent.begin(), path);
+    cachedBytes += entry.bytes;
+    // Evicted targets are loaded again if asked for, their hashes are kept.
+    while (cachedBytes > MaxCachedTargetBytes && recent.size() > 1) {
+        auto &oldest = targets[recent.back()];
+        cachedBytes -= oldest.bytes;
+        oldest.future = {};
+        oldest.cached = false;
+        recent.pop_back();
+    }
+    return ret;
+}
@@ -0,0 +1,88 @@
+#ifndef PAYLOAD_H
+#define PAYLOAD_H
+
+#include <cstdint>
+#include <filesystem>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <gsl/span>
+
+#include "file_reader.h"
+#include "ggpk.h"
+#include "pixel_buffer.h"
+
+// How the game stores the contents of a texture file: plain DDS, a '*' followed by the path of another texture to use
+// instead, or a little-endian 32-bit size followed by that many bytes of DDS compressed with brotli.
+enum class PayloadKind {
+    Plain,
+    Redirect,
+    Compressed,
+};
+
+PayloadKind DetectPayload(gsl::span<uint8_t const> data);
+
+// The game relative path a redirect names, with forward slashes.
+std::string RedirectTarget(gsl::span<uint8_t const> data);
+
+// The decompressed contents, in a buffer from the calling thread's pool.
+PixelBuffer DecompressPayload(gsl::span<uint8_t const> data, std::string const &name);
+
+// Holds whatever the DDS contents returned by PayloadResolver::Resolve live in, when that is not the data passed in.
+struct PayloadScratch {
+    PixelBuffer unpacked;
+    std::shared_ptr<void const> target;
+};
+
+// Turns payloads into plain DDS. Redirect targets are looked up below a root directory, or in the archive if there is
+// one, and shared by all the files that point at them. Recently used targets stay loaded up to a byte limit, the
+// hashes of every target seen are kept for the whole run. Safe to use from several threads.
+class PayloadResolver {
+  public:
+    explicit PayloadResolver(std::filesystem::path root, GgpkArchive const *archive = nullptr)
+        : root(std::move(root)), archive(archive) {}
+
+    // The DDS contents for data: data itself, or the decompressed contents or redirect target kept alive by scratch.
+    gsl::span<uint8_t const> Resolve(gsl::span<uint8_t const> data, PayloadScratch &scratch, std::string const &name);
+
+    // Hash of the DDS contents that a redirect resolves to, loading the target if it has not been seen yet.
+    uint64_t RedirectHash(gsl::span<uint8_t const> data);
+
+  private:
+    // Targets in the archive are used in place, those read from disk or decompressed are owned here.
+    struct TargetData {
+        std::vector<uint8_t> file;
+        PixelBuffer unpacked;
+        gsl::span<uint8_t const> data;
+        uint64_t hash;
+    };
+    using Target = std::shared_ptr<TargetData const>;
+
+    struct CachedTarget {
+        // Valid while the target is loading or cached, and for targets that failed to load.
+        std::shared_future<Target> future;
+        std::list<std::string>::iterator recent;
+        bool cached{};
+        // Bytes owned by the cached target, nothing for those used in place from the archive.
+        size_t bytes{};
+        bool hashed{};
+        uint64_t hash{};
+    };
+
+    Target LoadTarget(std::string const &path);
+
+    std::filesystem::path root;
+    GgpkArchive const *archive;
+    std::mutex mutex;
+    std::unordered_map<std::string, CachedTarget> targets;
+    // Paths of cached targets, most recently used first.
+    std::list<std::string> recent;
+    size_t cachedBytes = 0;
+};
+
+#endif // PAYLOAD_H
@@ -0,0 +1,22 @@
+#include "pipeline.h"
+
+void Pipeline::PrintReport(FILE *fh, double seconds) const {
+    StageStats const *bottleneck = nullptr;
+    double bottleneckBusy = 0.0;
+
+    fprintf(fh, "%-10s %7s %9s %7s %9s %9s\n", "stage", "threads", "items", "busy", "starved", "blocked");
+    for (auto &stage : stages) {
+        double threadNs = seconds * 1e9 * stage->threads;
+        auto share = [&](int64_t ns) { return threadNs > 0.0 ? 100.0 * ns / threadNs : 0.0; };
+        double busy = share(stage->busyNs);
+        fprintf(fh, "%-10s %7u %9zu %6.1f%% %8.1f%% %8.1f%%\n", stage->name.c_str(), stage->threads,
+                stage->items.load(), busy, share(stage->inputWaitNs), share(stage->outputWaitNs));
+        if (!bottleneck || busy > bottleneckBusy) {
+            bottleneck = stage.get();
+            bottleneckBusy = busy;
+        }
+    }
+    if (bottleneck) {
+        fprintf(fh, "bottleneck: %s\n", bottleneck->name.c_str());
+    }
+}
@@ -0,0 +1,189 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "trace.h"
+
+// Fixed capacity queue between two pipeline stages. Producers block while it is full, which bounds how much work is
+// in flight between the stages.
+template <typename T> class BoundedQueue {
+  public:
+    explicit BoundedQueue(size_t capacity) : capacity(capacity ? capacity : 1) {}
+
+    // Blocks while the queue is full. Returns false if the queue was closed.
+    bool Push(T item) {
+        std::unique_lock lk(mutex);
+        notFull.wait(lk, [&] { return items.size() < capacity || closed; });
+        if (closed) {
+            return false;
+        }
+        items.push_back(std::move(item));
+        notEmpty.notify_one();
+        return true;
+    }
+
+    // Blocks while the queue is empty and open. Returns nothing once the queue is closed and drained.
+    std::optional<T> Pop() {
+        std::unique_lock lk(mutex);
+        notEmpty.wait(lk, [&] { return !items.empty() || closed; });
+        if (items.empty()) {
+            return {};
+        }
+        T ret = std::move(items.front());
+        items.pop_front();
+        notFull.notify_one();
+        return ret;
+    }
+
+    void Close() {
+        std::lock_guard lk(mutex);
+        closed = true;
+        notEmpty.notify_all();
+        notFull.notify_all();
+    }
+
+  private:
+    std::mutex mutex;
+    std::condition_variable notFull, notEmpty;
+    std::deque<T> items;
+    size_t capacity;
+    bool closed{};
+};
+
+// Where the threads of one stage spent their time.
+struct StageStats {
+    StageStats(std::string name, unsigned threads) : name(std::move(name)), threads(threads) {}
+
+    std::string name;
+    unsigned threads;
+    std::atomic<size_t> items{0};
+    std::atomic<int64_t> busyNs{0};
+    std::atomic<int64_t> inputWaitNs{0};
+    std::atomic<int64_t> outputWaitNs{0};
+};
+
+// A chain of stages connected by bounded queues, each stage running on its own set of threads. Stage functions take
+// an item by value and must not throw; stages with an output return an optional result, and items they return
+// nothing for are dropped. A stage closes its output queue once all its threads have seen the input close.
+class Pipeline {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    Pipeline() = default;
+    Pipeline(Pipeline const &) = delete;
+    Pipeline &operator=(Pipeline const &) = delete;
+    ~Pipeline() { Wait(); }
+
+    template <typename In, typename Out, typename Func>
+    void AddStage(std::string name, unsigned threadCount, BoundedQueue<In> &in, BoundedQueue<Out> &out, Func func) {
+        auto process = [&out, func](In item) -> int64_t {
+            std::optional<Out> result = func(std::move(item));
+            if (!result) {
+                return 0;
+            }
+            auto start = Clock::now();
+            out.Push(std::move(*result));
+            return Elapsed(start);
+        };
+        Spawn<In>(std::move(name), threadCount, in, process, [&out] { out.Close(); });
+    }
+
+    // A first stage that produces items rather than taking them from a queue. Each of its threads calls func(emit)
+    // once, and func passes items to emit until it runs out of them.
+    template <typename Out, typename Func>
+    void AddSource(std::string name, unsigned threadCount, BoundedQueue<Out> &out, Func func) {
+        threadCount = threadCount ? threadCount : 1;
+        auto &stats = *stages.emplace_back(std::make_unique<StageStats>(std::move(name), threadCount));
+        auto remaining = std::make_shared<std::atomic<unsigned>>(threadCount);
+        for (unsigned i = 0; i < threadCount; ++i) {
+            threads.emplace_back([&stats, &out, func, remaining] {
+                SetTraceThreadName(stats.name);
+                int64_t outputWait = 0;
+                auto emit = [&](Out item) {
+                    auto start = Clock::now();
+                    out.Push(std::move(item));
+                    outputWait += Elapsed(start);
+                    ++stats.items;
+                };
+                auto start = Clock::now();
+                func(emit);
+                stats.busyNs += Elapsed(start) - outputWait;
+                stats.outputWaitNs += outputWait;
+                if (--*remaining == 0) {
+                    out.Close();
+                }
+            });
+        }
+    }
+
+    template <typename In, typename Func>
+    void AddSink(std::string name, unsigned threadCount, BoundedQueue<In> &in, Func func) {
+        auto process = [func](In item) -> int64_t {
+            func(std::move(item));
+            return 0;
+        };
+        Spawn<In>(std::move(name), threadCount, in, process, [] {});
+    }
+
+    void Wait() {
+        for (auto &thread : threads) {
+            if (thread.joinable()) {
+                thread.join();
+            }
+        }
+    }
+
+    // Per stage share of thread time spent working, waiting for input and waiting to pass results on. The stage
+    // with the highest busy share is the bottleneck.
+    void PrintReport(FILE *fh, double seconds) const;
+
+  private:
+    static int64_t Elapsed(Clock::time_point since) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - since).count();
+    }
+
+    // Process runs one item and returns how long it spent blocked on the output queue.
+    template <typename In, typename Process, typename Finish>
+    void Spawn(std::string name, unsigned threadCount, BoundedQueue<In> &in, Process process, Finish finish) {
+        threadCount = threadCount ? threadCount : 1;
+        auto &stats = *stages.emplace_back(std::make_unique<StageStats>(std::move(name), threadCount));
+        auto remaining = std::make_shared<std::atomic<unsigned>>(threadCount);
+        for (unsigned i = 0; i < threadCount; ++i) {
+            threads.emplace_back([&stats, &in, process, finish, remaining] {
+                SetTraceThreadName(stats.name);
+                while (true) {
+                    auto start = Clock::now();
+                    std::optional<In> item = in.Pop();
+                    stats.inputWaitNs += Elapsed(start);
+                    if (!item) {
+                        break;
+                    }
+                    start = Clock::now();
+                    int64_t outputWait = process(std::move(*item));
+                    stats.busyNs += Elapsed(start) - outputWait;
+                    stats.outputWaitNs += outputWait;
+                    ++stats.items;
+                }
+                if (--*remaining == 0) {
+                    finish();
+                }
+            });
+        }
+    }
+
+    std::vector<std::unique_ptr<StageStats>> stages;
+    std::vector<std::thread> threads;
+};
+
+#endif // PIPELINE_H
@@ -0,0 +1,148 @@
+#include "pixel_buffer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <vector>
+
+// Buffers a pool holds on to, enough for the images of one decoding thread that are waiting in the queues of a batch,
+// without keeping an unbounded amount of memory around.
+static constexpr size_t MaxPooledBuffers = 8;
+
+// Bytes a pool holds on to, beyond which the largest of its other buffers are freed. The buffer returned last is always
+// kept, so that a thread converting one huge atlas after another still reuses its memory.
+static constexpr size_t MaxPooledBytes = size_t(256) << 20;
+
+// Sizes are rounded up to whole pages, which also keeps the high-water mark from creeping up a few bytes at a time.
+static constexpr size_t SizeGranularity = 4096;
+
+// New buffers are made at the high-water mark, but no more than this many times the size asked for.
+static constexpr size_t MaxGrowth = 2;
+
+static std::atomic<size_t> allocatedCount{0}, reusedCount{0}, allocatedBytes{0};
+
+struct PixelBuffer::Pool {
+    struct Entry {
+        uint8_t *ptr;
+        size_t capacity;
+    };
+
+    ~Pool() {
+        for (auto &entry : free) {
+            Deallocate(entry.ptr);
+        }
+    }
+
+    static uint8_t *Allocate(size_t capacity) {
+        ++allocatedCount;
+        allocatedBytes += capacity;
+        return static_cast<uint8_t *>(operator new(capacity, std::align_val_t(Alignment)));
+    }
+
+    static void Deallocate(uint8_t *ptr) { operator delete(ptr, std::align_val_t(Alignment)); }
+
+    Entry Acquire(size_t size) {
+        std::lock_guard lk(mutex);
+        size_t rounded = (size + SizeGranularity - 1) / SizeGranularity * SizeGranularity;
+        highWater = std::max(highWater, rounded);
+        // The smallest buffer that fits, leaving the larger ones for larger requests.
+        auto best = free.end();
+        for (auto I = free.begin(); I != free.end(); ++I) {
+            if (I->capacity >= size && (best == free.end() || I->capacity < best->capacity)) {
+                best = I;
+            }
+        }
+        if (best != free.end()) {
+            Entry ret = *best;
+            freeBytes -= ret.capacity;
+            free.erase(best);
+            ++reusedCount;
+            return ret;
+        }
+        size_t capacity = std::min(highWater, rounded * MaxGrowth);
+        return Entry{Allocate(capacity), capacity};
+    }
+
+    void Release(Entry entry) {
+        std::lock_guard lk(mutex);
+        free.push_back(entry);
+        freeBytes += entry.capacity;
+        auto byCapacity = [](auto &a, auto &b) { return a.capacity < b.capacity; };
+        if (free.size() > MaxPooledBuffers) {
+            Drop(std::min_element(free.begin(), free.end(), byCapacity));
+        }
+        // The buffer just returned is the one most likely to be asked for again, the others go first.
+        while (freeBytes > MaxPooledBytes && free.size() > 1) {
+            Drop(std::max_element(free.begin(), free.end() - 1, byCapacity));
+        }
+    }
+
+    void Trim() {
+        std::lock_guard lk(mutex);
+        while (!free.empty()) {
+            Drop(free.end() - 1);
+        }
+        highWater = 0;
+    }
+
+    void Drop(std::vector<Entry>::iterator entry) {
+        freeBytes -= entry->capacity;
+        Deallocate(entry->ptr);
+        free.erase(entry);
+    }
+
+    std::mutex mutex;
+    std::vector<Entry> free;
+    size_t freeBytes{};
+    size_t highWater{};
+};
+
+// Shared with the buffers handed out, so that a pool outlives its thread for as long as they are around.
+static std::shared_ptr<PixelBuffer::Pool> const &CurrentPool() {
+    thread_local auto const threadPool = std::make_shared<PixelBuffer::Pool>();
+    return threadPool;
+}
+
+PixelBuffer::PixelBuffer(size_t size) : bytes(size) {
+    if (size == 0) {
+        return;
+    }
+    pool = CurrentPool();
+    auto entry = pool->Acquire(size);
+    ptr = entry.ptr;
+    capacity = entry.capacity;
+}
+
+PixelBuffer::~PixelBuffer() { Release(); }
+
+PixelBuffer::PixelBuffer(PixelBuffer &&other) noexcept
+    : pool(std::move(other.pool)), ptr(other.ptr), bytes(other.bytes), capacity(other.capacity) {
+    other.ptr = nullptr;
+    other.bytes = other.capacity = 0;
+}
+
+PixelBuffer &PixelBuffer::operator=(PixelBuffer &&other) noexcept {
+    if (this != &other) {
+        Release();
+        pool = std::move(other.pool);
+        ptr = other.ptr;
+        bytes = other.bytes;
+        capacity = other.capacity;
+        other.ptr = nullptr;
+        other.bytes = other.capacity = 0;
+    }
+    return *this;
+}
+
+void PixelBuffer::Release() {
+    if (ptr) {
+        pool->Release(Pool::Entry{ptr, capacity});
+        pool.reset();
+        ptr = nullptr;
+    }
+}
+
+void TrimPixelBufferPool() { CurrentPool()->Trim(); }
+
+PixelBufferCounters GetPixelBufferCounters() { return {allocatedCount, reusedCount, allocatedBytes}; }
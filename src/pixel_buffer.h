@@ -0,0 +1,62 @@
+#ifndef PIXEL_BUFFER_H
+#define PIXEL_BUFFER_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Uninitialised, cache line aligned memory for pixels, intermediate image data and the contents of files being
+// converted.
+//
+// Each thread allocates from a pool of its own, and a buffer goes back to the pool it came from when it is destroyed,
+// on whichever thread that happens. Pools keep a few buffers around and size new ones by the largest request they
+// have seen, up to twice the size asked for, so that once a batch has seen its largest images no more memory is
+// allocated or faulted in, while a large scratch buffer does not inflate every small one after it. What a pool keeps
+// is also capped in bytes, and is freed when its thread exits or calls TrimPixelBufferPool.
+class PixelBuffer {
+  public:
+    static constexpr size_t Alignment = 64;
+
+    PixelBuffer() = default;
+    explicit PixelBuffer(size_t size);
+    ~PixelBuffer();
+
+    PixelBuffer(PixelBuffer &&other) noexcept;
+    PixelBuffer &operator=(PixelBuffer &&other) noexcept;
+    PixelBuffer(PixelBuffer const &) = delete;
+    PixelBuffer &operator=(PixelBuffer const &) = delete;
+
+    uint8_t *data() { return ptr; }
+    uint8_t const *data() const { return ptr; }
+    size_t size() const { return bytes; }
+    bool empty() const { return bytes == 0; }
+
+    // Drops the bytes past `size`, which is no more than the current size, keeping the memory.
+    void truncate(size_t size) { bytes = std::min(bytes, size); }
+
+    struct Pool;
+
+  private:
+    void Release();
+
+    std::shared_ptr<Pool> pool;
+    uint8_t *ptr{};
+    size_t bytes{};
+    size_t capacity{};
+};
+
+// Frees the buffers that the calling thread's pool is holding on to and forgets the sizes it has seen, for threads that
+// are done converting for a while. Buffers still in use return to the pool as usual.
+void TrimPixelBufferPool();
+
+// Process wide totals, for judging how well the pools work.
+struct PixelBufferCounters {
+    size_t allocated{};
+    size_t reused{};
+    size_t allocatedBytes{};
+};
+
+PixelBufferCounters GetPixelBufferCounters();
+
+#endif // PIXEL_BUFFER_H
@@ -0,0 +1,169 @@
+#include "poeimage.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <string>
+
+#include <fmt/core.h>
+
+#include "convert.h"
+#include "payload.h"
+#include "pixel_buffer.h"
+#include "resample.h"
+
+static thread_local std::string lastError;
+
+namespace {
+// Raised for bad arguments, which are reported separately from inputs that fail to convert.
+struct InvalidArgument : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+// A texture loaded from caller memory and ready to decode.
+struct Source {
+    Source(void const *src, size_t srcSize, PoeImageOptions const *callerOptions) {
+        if (!src) {
+            throw InvalidArgument("source is null");
+        }
+        PoeImageOptions opts;
+        PoeImageDefaultOptions(&opts);
+        if (callerOptions) {
+            if (callerOptions->structSize < sizeof(uint32_t)) {
+                throw InvalidArgument("options structSize is not set");
+            }
+            memcpy(&opts, callerOptions, std::min<size_t>(callerOptions->structSize, sizeof(opts)));
+        }
+
+        if (opts.mipLevel >= 0) {
+            options.mipLevel = opts.mipLevel;
+        }
+        if (opts.maxWidth || opts.maxHeight) {
+            if (options.mipLevel) {
+                throw InvalidArgument("mipLevel and a maximum size are mutually exclusive");
+            }
+            options.maxSize = glm::ivec2(opts.maxWidth ? std::min<uint32_t>(opts.maxWidth, INT_MAX) : INT_MAX,
+                                         opts.maxHeight ? std::min<uint32_t>(opts.maxHeight, INT_MAX) : INT_MAX);
+        }
+        if (opts.outputSize) {
+            options.sizes = {static_cast<int>(std::min<uint32_t>(opts.outputSize, INT_MAX))};
+        }
+        if (opts.filter > POEIMAGE_FILTER_MITCHELL) {
+            throw InvalidArgument(fmt::format("unknown filter: {}", opts.filter));
+        }
+        options.filter = opts.filter == POEIMAGE_FILTER_MITCHELL ? ResampleFilter::Mitchell : ResampleFilter::Lanczos3;
+        std::optional<Rect> crop;
+        if (opts.cropWidth && opts.cropHeight) {
+            if (opts.cropX > INT_MAX || opts.cropY > INT_MAX || opts.cropWidth > INT_MAX || opts.cropHeight > INT_MAX) {
+                throw InvalidArgument("crop out of range");
+            }
+            crop = Rect{glm::ivec2(opts.cropX, opts.cropY), glm::ivec2(opts.cropWidth, opts.cropHeight)};
+        }
+
+        // Redirects name other files, which a caller that only passes bytes has to resolve itself.
+        gsl::span<uint8_t const> data(static_cast<uint8_t const *>(src), srcSize);
+        switch (DetectPayload(data)) {
+        case PayloadKind::Plain:
+            break;
+        case PayloadKind::Compressed:
+            unpacked = DecompressPayload(data, "source");
+            data = gsl::span<uint8_t const>(unpacked.data(), unpacked.size());
+            break;
+        case PayloadKind::Redirect:
+            throw std::runtime_error(fmt::format("source is a redirect to {}", RedirectTarget(data)));
+        }
+        texture = LoadTexture(data, "source");
+        decoder.emplace(texture.tex, crop, options, "source");
+    }
+
+    glm::ivec2 OutputExtent() {
+        glm::ivec2 extent = decoder->GetImage().extent;
+        return options.sizes.empty() ? extent : FitExtent(extent, options.sizes[0]);
+    }
+
+    Image Decode() {
+        decoder->DecodeBlockRows(0, decoder->BlockRowCount());
+        if (options.sizes.empty()) {
+            return std::move(decoder->GetImage());
+        }
+        return Resample(decoder->GetImage(), OutputExtent(), options.filter);
+    }
+
+    ConvertOptions options;
+    PixelBuffer unpacked;
+    LoadedTexture texture;
+    std::optional<TextureDecoder> decoder;
+};
+} // namespace
+
+template <typename Func> static PoeImageStatus Guard(Func func) {
+    try {
+        return func();
+    } catch (InvalidArgument &e) {
+        lastError = e.what();
+        return POEIMAGE_INVALID_ARGUMENT;
+    } catch (std::exception &e) {
+        lastError = e.what();
+    } catch (...) {
+        lastError = "unknown error";
+    }
+    return POEIMAGE_FAILED;
+}
+
+uint32_t PoeImageVersion(void) { return POEIMAGE_VERSION; }
+
+void PoeImageDefaultOptions(PoeImageOptions *options) {
+    if (options) {
+        *options = PoeImageOptions{};
+        options->structSize = sizeof(PoeImageOptions);
+        options->mipLevel = -1;
+    }
+}
+
+PoeImageStatus PoeImageDecode(void const *src, size_t srcSize, PoeImageOptions const *options, void *dst,
+                              size_t *dstSize, PoeImageInfo *info) {
+    return Guard([&] {
+        if (!dstSize) {
+            throw InvalidArgument("dstSize is null");
+        }
+        Source source(src, srcSize, options);
+        glm::ivec2 extent = source.OutputExtent();
+        int components = source.decoder->GetImage().components;
+        if (info) {
+            *info = PoeImageInfo{uint32_t(extent.x), uint32_t(extent.y), uint32_t(components)};
+        }
+        size_t needed = size_t(extent.x) * extent.y * components;
+        size_t capacity = *dstSize;
+        *dstSize = needed;
+        if (!dst || capacity < needed) {
+            return POEIMAGE_BUFFER_TOO_SMALL;
+        }
+        Image image = source.Decode();
+        memcpy(dst, image.data.data(), needed);
+        return POEIMAGE_OK;
+    });
+}
+
+PoeImageStatus PoeImageConvertPng(void const *src, size_t srcSize, PoeImageOptions const *options, void *dst,
+                                  size_t *dstSize) {
+    return Guard([&] {
+        if (!dstSize) {
+            throw InvalidArgument("dstSize is null");
+        }
+        Source source(src, srcSize, options);
+        std::vector<uint8_t> png = EncodePng(source.Decode());
+        size_t capacity = *dstSize;
+        *dstSize = png.size();
+        if (!dst || capacity < png.size()) {
+            return POEIMAGE_BUFFER_TOO_SMALL;
+        }
+        memcpy(dst, png.data(), png.size());
+        return POEIMAGE_OK;
+    });
+}
+
+char const *PoeImageLastError(void) { return lastError.c_str(); }
+
+void PoeImageReleaseThreadCaches(void) { TrimPixelBufferPool(); }
@@ -0,0 +1,99 @@
+#ifndef POEIMAGE_H
+#define POEIMAGE_H
+
+// C interface to the texture conversion of process-image, for use from other languages without starting a process per
+// image. Every function is safe to call from several threads at once. Callers own all memory: inputs are only read
+// during the call and outputs are written into buffers the caller provides.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(_WIN32)
+#ifdef POEIMAGE_BUILD
+#define POEIMAGE_API __declspec(dllexport)
+#else
+#define POEIMAGE_API __declspec(dllimport)
+#endif
+#else
+#define POEIMAGE_API __attribute__((visibility("default")))
+#endif
+
+// Bumped when the interface changes incompatibly. Fields are only ever added to the end of PoeImageOptions.
+#define POEIMAGE_VERSION 1
+
+typedef enum PoeImageStatus {
+    POEIMAGE_OK = 0,
+    // A required pointer was null or an option was out of range, see PoeImageLastError.
+    POEIMAGE_INVALID_ARGUMENT = 1,
+    // The output buffer was missing or too small, the size it needs to be was stored.
+    POEIMAGE_BUFFER_TOO_SMALL = 2,
+    // The input could not be loaded or converted, see PoeImageLastError.
+    POEIMAGE_FAILED = 3,
+} PoeImageStatus;
+
+typedef enum PoeImageFilter {
+    POEIMAGE_FILTER_LANCZOS3 = 0,
+    POEIMAGE_FILTER_MITCHELL = 1,
+} PoeImageFilter;
+
+typedef struct PoeImageOptions {
+    // sizeof(PoeImageOptions) as compiled into the caller, so that callers built against older versions keep working.
+    uint32_t structSize;
+    // Mip level to decode, or -1 to pick one from the maximum size or output size, falling back to the base level.
+    int32_t mipLevel;
+    // Largest decoded size, picking the largest mip level that fits, 0 for no limit.
+    uint32_t maxWidth;
+    uint32_t maxHeight;
+    // Region to decode in base level pixels, the whole image when the width or height is 0.
+    uint32_t cropX;
+    uint32_t cropY;
+    uint32_t cropWidth;
+    uint32_t cropHeight;
+    // Resample to the largest size with the same aspect ratio that fits in this square, 0 to keep the decoded size.
+    uint32_t outputSize;
+    // A PoeImageFilter for resampling.
+    uint32_t filter;
+} PoeImageOptions;
+
+typedef struct PoeImageInfo {
+    uint32_t width;
+    uint32_t height;
+    // Bytes per pixel of the decoded image, 3 for RGB or 4 for RGBA.
+    uint32_t components;
+} PoeImageInfo;
+
+POEIMAGE_API uint32_t PoeImageVersion(void);
+
+// Fills in the defaults: the base level, no crop, no resampling.
+POEIMAGE_API void PoeImageDefaultOptions(PoeImageOptions *options);
+
+// Decodes a DDS texture, or a compressed one as stored by the game, to 8-bit pixels with tightly packed rows. On entry
+// *dstSize is the capacity of dst, on return the size of the image. When dst is null or too small nothing is decoded
+// and POEIMAGE_BUFFER_TOO_SMALL is returned with the needed size, so a first call with a null dst gives the size
+// without decoding. info, which may be null, receives the layout of the image.
+POEIMAGE_API PoeImageStatus PoeImageDecode(void const *src, size_t srcSize, PoeImageOptions const *options, void *dst,
+                                           size_t *dstSize, PoeImageInfo *info);
+
+// Decodes like PoeImageDecode and encodes the result as PNG into dst. The PNG size is only known after encoding, so a
+// call with a buffer that turns out too small does all the work before returning POEIMAGE_BUFFER_TOO_SMALL, and
+// callers should start with a generous buffer, such as the size of the decoded image.
+POEIMAGE_API PoeImageStatus PoeImageConvertPng(void const *src, size_t srcSize, PoeImageOptions const *options,
+                                               void *dst, size_t *dstSize);
+
+// Description of the last failure on the calling thread, valid until the next call on it.
+POEIMAGE_API char const *PoeImageLastError(void);
+
+// Each thread that decodes keeps some of its working memory for the next call: up to 256 MiB, or one buffer if a
+// single image needs more, until the thread exits. This frees what the calling thread kept, for threads that are
+// done with images for a while or belong to a pool that outlives its use of this library.
+POEIMAGE_API void PoeImageReleaseThreadCaches(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // POEIMAGE_H
@@ -0,0 +1,15 @@
+#include "probes.h"
+
+#ifdef PROCESS_IMAGE_HAS_USDT
+// Tracers find the semaphores through the probe notes and increment them while attached.
+#define DEFINE_PROBE_SEMAPHORE(name)                                                                                   \
+    volatile unsigned short PROBE_SEMAPHORE(name) __attribute__((unused, section(".probes"))) = 0
+
+extern "C" {
+DEFINE_PROBE_SEMAPHORE(load__start);
+DEFINE_PROBE_SEMAPHORE(load__end);
+DEFINE_PROBE_SEMAPHORE(decode__band);
+DEFINE_PROBE_SEMAPHORE(png__encode);
+DEFINE_PROBE_SEMAPHORE(request__done);
+}
+#endif
@@ -0,0 +1,57 @@
+#ifndef PROBES_H
+#define PROBES_H
+
+#include <chrono>
+#include <cstdint>
+
+// USDT probes for attaching bpftrace or perf to a running process, under the provider process_image:
+//
+//   load__start(name, bytes)                           before a texture is parsed
+//   load__end(name, format, width, height, ns)         after it was parsed
+//   decode__band(name, format, first_row, end_row, ns) for each band of block rows decoded
+//   png__encode(width, height, components, bytes, ns)  for each PNG compressed
+//   request__done(name, index, failed, bytes_written)  for each file or frame a batch finishes
+//
+// A probe site is a single nop. Each probe also has a semaphore that tracers raise while attached, and the clock is
+// only read for the durations while it is raised.
+
+#if defined(PROCESS_IMAGE_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define PROCESS_IMAGE_HAS_USDT 1
+#endif
+#endif
+
+#ifdef PROCESS_IMAGE_HAS_USDT
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+
+#define PROBE_SEMAPHORE(name) process_image_##name##_semaphore
+#define PROBE_ENABLED(name) __builtin_expect(PROBE_SEMAPHORE(name) != 0, 0)
+#define PROBE(name, ...) STAP_PROBEV(process_image, name, __VA_ARGS__)
+
+extern "C" {
+extern volatile unsigned short PROBE_SEMAPHORE(load__start);
+extern volatile unsigned short PROBE_SEMAPHORE(load__end);
+extern volatile unsigned short PROBE_SEMAPHORE(decode__band);
+extern volatile unsigned short PROBE_SEMAPHORE(png__encode);
+extern volatile unsigned short PROBE_SEMAPHORE(request__done);
+}
+#else
+#define PROBE_ENABLED(name) false
+// The arguments are still named in an unevaluated operand, so that values only passed to probes do not warn as unused.
+#define PROBE(name, ...)                                                                                               \
+    do {                                                                                                               \
+        (void)sizeof((__VA_ARGS__, 0));                                                                                \
+    } while (0)
+#endif
+
+// Start time for a probe with a duration, zero while nothing is attached to it.
+#define PROBE_START(name) (PROBE_ENABLED(name) ? ProbeNowNs() : int64_t(0))
+
+inline int64_t ProbeNowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+#endif // PROBES_H
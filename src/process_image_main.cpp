@@ -1,5 +1,14 @@
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
 #include <deque>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <gsl/span>
 
@@ -8,28 +17,24 @@
 #include <gli/gli.hpp>
 #include <gli/load.hpp>
 
-#define STB_IMAGE_WRITE_IMPLEMENTATION 1
-#include <stb_image_write.h>
-
+#include "batch.h"
 #include "cmp_core.h"
+#include "compress.h"
+#include "convert.h"
+#include "dds.h"
+#include "ggpk.h"
 #include "gli_format_names.h"
-
-struct Rect {
-    glm::ivec2 origin;
-    glm::ivec2 size;
-};
+#include "image.h"
+#include "info.h"
+#include "manifest.h"
+#include "payload.h"
+#include "resample.h"
+#include "stats.h"
+#include "thread_pool.h"
+#include "trace.h"
 
 std::string Usage() { return ""; }
 
-static int IntoInt(std::string const &s) {
-    std::size_t pos{};
-    int ret = std::stoi(s, &pos, 10);
-    if (pos != s.size()) {
-        throw std::runtime_error("invalid integer");
-    }
-    return ret;
-}
-
 template <typename CompType, size_t CompCount>
 static void Blit(gli::texture2d const &srcTex, gli::texture2d &dstTex, glm::ivec2 srcOrigin, glm::ivec2 size,
                  glm::ivec2 dstOrigin) {
@@ -45,39 +50,36 @@ static void Blit(gli::texture2d const &srcTex, gli::texture2d &dstTex, glm::ivec
     }
 }
 
-struct Image {
-    Image(gli::ivec2 extent, int components)
-        : extent(extent), components(components), data(extent.x * extent.y * components) {}
+static std::unique_ptr<GgpkArchive> OpenArchive(std::optional<std::string> const &path) {
+    return path ? std::make_unique<GgpkArchive>(*path) : nullptr;
+}
 
-    uint8_t *GetPixel(gli::ivec2 pixelCoord) {
-        int idx = pixelCoord.x + extent.x * pixelCoord.y;
-        return data.data() + components * idx;
+static void StartRun(ConvertOptions const &options) {
+    if (options.forceIsa) {
+        ForceIsa(*options.forceIsa);
     }
-
-    int GetStride() const { return extent.x * components; }
-
-    gli::ivec2 extent{};
-    int components{};
-    std::vector<uint8_t> data;
-};
-
-struct ImageRef {
-    ImageRef(gli::ivec2 extent, int comp, gsl::span<uint8_t const> data)
-        : extent(extent), components(comp), data(data) {}
-
-    uint8_t const *GetPixel(gli::ivec2 pixelCoord) const {
-        int idx = pixelCoord.x + extent.x * pixelCoord.y;
-        return data.data() + components * idx;
+    if (options.stats) {
+        EnableStats();
     }
+    if (options.tracePath) {
+        EnableTrace();
+    }
+}
 
-    gli::ivec2 extent{};
-    int components{};
-    gsl::span<uint8_t const> data;
-};
+static void FinishRun(ConvertOptions const &options) {
+    if (options.stats) {
+        fputs(FormatStats(*options.stats).c_str(), stderr);
+    }
+    if (options.tracePath) {
+        WriteTrace(*options.tracePath);
+    }
+}
 
 void ConvertCommand(std::deque<std::string> args) {
-    Rect crop;
+    std::optional<Rect> crop;
     std::string srcPath, dstPath;
+    ConvertOptions options = ExtractConvertOptions(args);
+    StartRun(options);
 
     if (args.size() != 2 && args.size() != 6) {
         throw std::runtime_error("invalid argument count");
@@ -85,194 +87,471 @@ void ConvertCommand(std::deque<std::string> args) {
     srcPath = args[0];
     dstPath = args[1];
 
-    if (srcPath.size() < 4 || srcPath.substr(srcPath.size() - 4) != ".dds") {
+    // "-" reads the DDS from standard input and writes the PNG to standard output.
+    bool fromStdin = srcPath == "-", toStdout = dstPath == "-";
+    if (!fromStdin && (srcPath.size() < 4 || srcPath.substr(srcPath.size() - 4) != ".dds")) {
         throw std::runtime_error(fmt::format("input image must be a DDS file: {}", srcPath));
     }
-    if (dstPath.size() < 4 || dstPath.substr(dstPath.size() - 4) != ".png") {
+    if (!toStdout && (dstPath.size() < 4 || dstPath.substr(dstPath.size() - 4) != ".png")) {
         throw std::runtime_error(fmt::format("output image must be a PNG file: {}", dstPath));
     }
+    if (toStdout && options.sizes.size() > 1) {
+        throw std::runtime_error("only one output size can be written to standard output");
+    }
 
-    gli::texture2d srcTex{gli::load(srcPath)};
-    if (srcTex.empty()) {
-        throw std::runtime_error(fmt::format("could not load texture: {}", srcPath));
+    auto archive = OpenArchive(options.ggpkPath);
+    std::vector<uint8_t> srcData;
+    gsl::span<uint8_t const> srcBytes;
+    if (fromStdin) {
+        srcData = ReadStream(BinaryStdin(), "standard input");
+        srcBytes = srcData;
+    } else {
+        srcBytes = ReadSource(srcPath, archive.get(), srcData);
     }
+    PayloadScratch scratch;
+    PayloadResolver resolver(options.redirectRoot.value_or("."), archive.get());
+    LoadedTexture src = LoadTexture(resolver.Resolve(srcBytes, scratch, srcPath), srcPath);
 
-    auto fmt = srcTex.format();
-    auto extent = srcTex.extent(srcTex.base_level());
+    if (args.size() == 6) {
+        crop = Rect{glm::ivec2(IntoInt(args[2]), IntoInt(args[3])), glm::ivec2(IntoInt(args[4]), IntoInt(args[5]))};
+    }
 
-    if (gli::is_float(fmt)) {
-        throw std::runtime_error(fmt::format("floating point textures unsupported", srcPath));
+    TextureDecoder decoder(src.tex, crop, options, srcPath);
+    decoder.DecodeBlockRows(0, decoder.BlockRowCount());
+    if (toStdout) {
+        auto encoded = EncodeOutput(decoder.GetImage(), dstPath, options, 0);
+        FILE *out = BinaryStdout();
+        if (fwrite(encoded.png.data(), 1, encoded.png.size(), out) != encoded.png.size() || fflush(out) != 0) {
+            throw std::runtime_error("could not write to standard output");
+        }
+    } else {
+        WriteOutputs(decoder.GetImage(), dstPath, options);
     }
+    FinishRun(options);
+}
 
-    if (srcTex.layers() > 1 || srcTex.faces() > 1) {
-        throw std::runtime_error(fmt::format("non-2D images unsupported: {}", srcPath));
+static bool HasDdsExtension(std::filesystem::path const &path) {
+    auto ext = path.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char ch) { return std::tolower(ch); });
+    return ext == ".dds";
+}
+
+void ConvertTreeCommand(std::deque<std::string> args) {
+    namespace fs = std::filesystem;
+
+    std::optional<fs::path> manifestPath;
+    bool force = false;
+    for (auto I = args.begin(); I != args.end();) {
+        if (*I == "--manifest") {
+            if (I + 1 == args.end()) {
+                throw std::runtime_error(fmt::format("missing value for option {}", *I));
+            }
+            manifestPath = fs::path(I[1]);
+            I = args.erase(I, I + 2);
+        } else if (*I == "--force") {
+            force = true;
+            I = args.erase(I);
+        } else {
+            ++I;
+        }
     }
+    PipelineOptions pipelineOptions = ExtractPipelineOptions(args);
+    ConvertOptions options = ExtractConvertOptions(args);
+    StartRun(options);
 
-    if (args.size() == 6) {
-        crop.origin = glm::ivec2(IntoInt(args[2]), IntoInt(args[3]));
-        crop.size = glm::ivec2(IntoInt(args[4]), IntoInt(args[5]));
+    if (args.size() != 2) {
+        throw std::runtime_error("invalid argument count");
+    }
+    auto archive = OpenArchive(options.ggpkPath);
+    fs::path srcDir = args[0];
+    fs::path dstDir = args[1];
+    bool fromArchive = IsGgpkPath(args[0]);
+    if (fromArchive && !archive) {
+        throw std::runtime_error(fmt::format("no archive given with --ggpk for: {}", args[0]));
+    }
+    if (!fromArchive && !fs::is_directory(srcDir)) {
+        throw std::runtime_error(fmt::format("source is not a directory: {}", srcDir.string()));
+    }
+    if (!manifestPath) {
+        manifestPath = dstDir / ".process-image-manifest";
+    }
+    Manifest const previous = force ? Manifest{} : Manifest::Load(*manifestPath);
+    if (!options.redirectRoot && !fromArchive) {
+        options.redirectRoot = srcDir.string();
+    }
+
+    std::vector<ConvertJob> jobs;
+    auto addJob = [&](std::string srcPath, std::string key, uintmax_t size, int64_t mtime) {
+        ConvertJob job;
+        job.srcPath = std::move(srcPath);
+        job.key = std::move(key);
+        job.dstPath = (dstDir / fs::path(job.key).replace_extension(".png")).string();
+        job.size = size;
+        job.mtime = mtime;
+        jobs.push_back(std::move(job));
+    };
+    if (fromArchive) {
+        // Every file in the archive shares its time stamp, so after a patch the contents decide what changed.
+        std::string dir(GgpkEntryPath(args[0]));
+        dir.erase(0, dir.find_first_not_of("/\\"));
+        dir.erase(dir.find_last_not_of("/\\") + 1);
+        for (auto const *entry : archive->List(dir)) {
+            if (HasDdsExtension(entry->path)) {
+                addJob(fmt::format("{}{}", GgpkPrefix, entry->path),
+                       entry->path.substr(dir.empty() ? 0 : dir.size() + 1), entry->size, archive->Mtime());
+            }
+        }
     } else {
-        crop.origin = glm::ivec2(0, 0);
-        crop.size = extent;
-    }
-
-    if (crop.size.x == 0 || crop.size.y == 0) {
-        throw std::runtime_error(fmt::format("crop specification is of zero size: x={}, y={}, width={}, height={}, {}",
-                                             crop.origin.x, crop.origin.y, crop.size.x, crop.size.y, srcPath));
-    }
-
-    if (glm::ivec2 end = crop.origin + crop.size; end.x > extent.x || end.y > extent.y) {
-        throw std::runtime_error(
-            fmt::format("crop specification exceeds image size: x={}, y={}, width={}, height={}, {}", crop.origin.x,
-                        crop.origin.y, crop.size.x, crop.size.y, srcPath));
-    }
-
-    gli::texture2d dstTex;
-    gli::format dstFormat = gli::FORMAT_UNDEFINED;
-
-    std::optional<Image> dstImg;
-
-    if (gli::is_compressed(fmt)) {
-        gli::format midFormat;
-        std::function<void(uint8_t const *, uint8_t *, void *)> decompressBlockFunc;
-
-        switch (fmt) {
-        case gli::FORMAT_RGBA_BP_UNORM_BLOCK16: {
-            midFormat = gli::FORMAT_RGBA8_UNORM_PACK8;
-            decompressBlockFunc = DecompressBlockBC7;
-        } break;
-        case gli::FORMAT_RGBA_DXT1_UNORM_BLOCK8: {
-            midFormat = gli::FORMAT_RGBA8_UNORM_PACK8;
-            decompressBlockFunc = DecompressBlockBC1;
-        } break;
-        case gli::FORMAT_RGBA_DXT3_UNORM_BLOCK16: {
-            midFormat = gli::FORMAT_RGBA8_UNORM_PACK8;
-            decompressBlockFunc = DecompressBlockBC2;
-        } break;
-        case gli::FORMAT_RGBA_DXT5_SRGB_BLOCK16: {
-            midFormat = gli::FORMAT_RGBA8_UNORM_PACK8;
-            decompressBlockFunc = DecompressBlockBC3;
-        } break;
-        default:
-            throw std::runtime_error(fmt::format("unhandled format {} ({}): {}", GliFormatName(fmt), fmt, srcPath));
+        for (auto &entry : fs::recursive_directory_iterator(srcDir)) {
+            if (entry.is_regular_file() && HasDdsExtension(entry.path())) {
+                addJob(entry.path().string(), entry.path().lexically_relative(srcDir).generic_string(),
+                       entry.file_size(), entry.last_write_time().time_since_epoch().count());
+            }
+        }
+    }
+    // Start the largest files first so that they do not end up alone at the tail of the run.
+    std::sort(jobs.begin(), jobs.end(), [](auto &a, auto &b) { return a.size > b.size; });
+
+    BatchSummary summary = RunBatch(jobs, options, pipelineOptions, &previous, archive.get());
+
+    // Files that failed are left out, so that they are tried again next time.
+    Manifest manifest;
+    for (auto &job : jobs) {
+        if (job.result) {
+            manifest.Set(job.key, *job.result);
         }
+    }
+    if (manifestPath->has_parent_path()) {
+        fs::create_directories(manifestPath->parent_path());
+    }
+    manifest.Save(*manifestPath);
 
-        auto srcSpan = gsl::make_span(srcTex.data<uint8_t>(0, 0, 0), srcTex.size(0));
-
-        auto blockSize = gli::block_size(fmt);
-        auto blockExtent = glm::ivec2(gli::block_extent(fmt));
-        auto blockCount = (extent + glm::ivec2(blockExtent - 1)) / glm::ivec2(blockExtent);
-        auto components = gli::component_count(fmt);
-
-        glm::ivec2 firstBlock(crop.origin / blockExtent);
-        glm::ivec2 lastBlock((crop.origin + crop.size + blockExtent - 1) / blockExtent);
-
-        Image workImg({4, 4}, 4);
-        dstImg = Image(crop.size, 4);
-
-        // Decode all the blocks that cover the desired pixel region
-        for (int blockY = firstBlock.y; blockY < lastBlock.y; ++blockY) {
-            for (int blockX = firstBlock.x; blockX < lastBlock.x; ++blockX) {
-                auto blockIdx = blockX + blockY * blockCount.x;
-                auto inSpan = srcSpan.subspan(blockIdx * blockSize, blockSize);
-                decompressBlockFunc(inSpan.data(), workImg.GetPixel({0, 0}), nullptr);
-                glm::ivec2 blockBase = glm::ivec2(blockX, blockY) * blockExtent;
-
-                auto blockRel = blockBase - crop.origin;
-                for (int midY = 0; midY < 4; ++midY) {
-                    auto pixRelY = blockRel.y + midY;
-                    if (pixRelY >= 0 && pixRelY < crop.size.y) {
-                        for (int midX = 0; midX < 4; ++midX) {
-                            auto pixRelX = blockRel.x + midX;
-                            if (pixRelX >= 0 && pixRelX < crop.size.x) {
-                                memcpy(dstImg->GetPixel({pixRelX, pixRelY}), workImg.GetPixel({midX, midY}),
-                                       workImg.components);
-                            }
-                        }
-                    }
+    PrintBatchSummary(summary, jobs.size());
+    FinishRun(options);
+    if (summary.failed) {
+        throw std::runtime_error(fmt::format("{} files failed to convert", summary.failed));
+    }
+}
+
+// Converts the files named in a list, one tab separated "SRC DST [x y w h]" entry per line, or with "- -" a stream of
+// length prefixed frames from standard input to standard output.
+void BatchCommand(std::deque<std::string> args) {
+    PipelineOptions pipelineOptions = ExtractPipelineOptions(args);
+    ConvertOptions options = ExtractConvertOptions(args);
+    StartRun(options);
+
+    if (args.size() == 2 && args[0] == "-" && args[1] == "-") {
+        auto archive = OpenArchive(options.ggpkPath);
+        BatchSummary summary = RunStream(BinaryStdin(), BinaryStdout(), options, pipelineOptions, archive.get());
+        PrintBatchSummary(summary, summary.converted + summary.failed);
+        FinishRun(options);
+        if (summary.failed) {
+            throw std::runtime_error(fmt::format("{} frames failed to convert", summary.failed));
+        }
+        return;
+    }
+    if (args.size() != 1) {
+        throw std::runtime_error("invalid argument count");
+    }
+    std::ifstream list(args[0]);
+    if (!list) {
+        throw std::runtime_error(fmt::format("could not open list: {}", args[0]));
+    }
+
+    std::vector<ConvertJob> jobs;
+    std::string line;
+    for (int lineNumber = 1; std::getline(list, line); ++lineNumber) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        std::vector<std::string> fields;
+        for (size_t pos = 0;;) {
+            size_t tab = line.find('\t', pos);
+            fields.push_back(line.substr(pos, tab - pos));
+            if (tab == std::string::npos) {
+                break;
+            }
+            pos = tab + 1;
+        }
+        if (fields.size() != 2 && fields.size() != 6) {
+            throw std::runtime_error(fmt::format("{}:{}: expected 2 or 6 fields, got {}", args[0], lineNumber,
+                                                 fields.size()));
+        }
+        ConvertJob job;
+        job.srcPath = fields[0];
+        job.dstPath = fields[1];
+        if (fields.size() == 6) {
+            job.crop = Rect{glm::ivec2(IntoInt(fields[2]), IntoInt(fields[3])),
+                            glm::ivec2(IntoInt(fields[4]), IntoInt(fields[5]))};
+        }
+        jobs.push_back(std::move(job));
+    }
+
+    auto archive = OpenArchive(options.ggpkPath);
+    BatchSummary summary = RunBatch(jobs, options, pipelineOptions, nullptr, archive.get());
+    PrintBatchSummary(summary, jobs.size());
+    FinishRun(options);
+    if (summary.failed) {
+        throw std::runtime_error(fmt::format("{} files failed to convert", summary.failed));
+    }
+}
+
+struct EncodeFormat {
+    char const *name;
+    gli::format unorm, srgb;
+};
+
+constexpr EncodeFormat EncodeFormats[] = {
+    {"bc1", gli::FORMAT_RGBA_DXT1_UNORM_BLOCK8, gli::FORMAT_RGBA_DXT1_SRGB_BLOCK8},
+    {"bc2", gli::FORMAT_RGBA_DXT3_UNORM_BLOCK16, gli::FORMAT_RGBA_DXT3_SRGB_BLOCK16},
+    {"bc3", gli::FORMAT_RGBA_DXT5_UNORM_BLOCK16, gli::FORMAT_RGBA_DXT5_SRGB_BLOCK16},
+    {"bc7", gli::FORMAT_RGBA_BP_UNORM_BLOCK16, gli::FORMAT_RGBA_BP_SRGB_BLOCK16},
+};
+
+// Compresses a PNG into a DDS, with as many mip levels as asked for, reporting progress on large images.
+void EncodeCommand(std::deque<std::string> args) {
+    EncodeFormat format = EncodeFormats[3];
+    bool srgb = false;
+    float quality = 0.05f;
+    int levels = 1;
+    ResampleFilter mipFilter = ResampleFilter::Box;
+    unsigned threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+    for (auto I = args.begin(); I != args.end();) {
+        if (*I == "--srgb") {
+            srgb = true;
+            I = args.erase(I);
+        } else if (*I == "--format" || *I == "--quality" || *I == "--threads" || *I == "--levels" ||
+                   *I == "--mip-filter") {
+            if (I + 1 == args.end()) {
+                throw std::runtime_error(fmt::format("missing value for option {}", *I));
+            }
+            std::string const &value = I[1];
+            if (*I == "--format") {
+                auto found = std::find_if(std::begin(EncodeFormats), std::end(EncodeFormats),
+                                          [&](auto &f) { return value == f.name; });
+                if (found == std::end(EncodeFormats)) {
+                    throw std::runtime_error(fmt::format("unknown format, expected bc1, bc2, bc3 or bc7: {}", value));
+                }
+                format = *found;
+            } else if (*I == "--quality") {
+                char *end = nullptr;
+                quality = std::strtof(value.c_str(), &end);
+                if (value.empty() || *end || !(quality >= 0.0f && quality <= 1.0f)) {
+                    throw std::runtime_error(fmt::format("invalid quality, expected 0 to 1: {}", value));
                 }
+            } else if (*I == "--levels") {
+                levels = IntoInt(value);
+                if (levels < 0) {
+                    throw std::runtime_error(fmt::format("invalid level count: {}", value));
+                }
+            } else if (*I == "--mip-filter") {
+                if (value == "box") {
+                    mipFilter = ResampleFilter::Box;
+                } else if (value == "kaiser") {
+                    mipFilter = ResampleFilter::Kaiser;
+                } else {
+                    throw std::runtime_error(fmt::format("unknown mip filter, expected box or kaiser: {}", value));
+                }
+            } else {
+                threadCount = unsigned(std::max(1, IntoInt(value)));
             }
+            I = args.erase(I, I + 2);
+        } else {
+            ++I;
         }
-    } else {
-        enum class MapTo {
-            Red = 0,
-            Green = 1,
-            Blue = 2,
-            Alpha = 3,
-            One,
-            Zero,
-        };
-        glm::vec<4, MapTo> compRemap{MapTo::Red, MapTo::Green, MapTo::Blue, MapTo::Alpha};
-        std::optional<ImageRef> srcImg;
-        glm::ivec2 srcExtent = srcTex.extent();
-        auto srcSpan = gsl::make_span(srcTex.data<uint8_t>(0, 0, 0), srcTex.size(0));
-        switch (fmt) {
-        case gli::FORMAT_BGR8_UNORM_PACK32: {
-            compRemap = {MapTo::Blue, MapTo::Green, MapTo::Red, MapTo::One};
-            srcImg = ImageRef(srcExtent, 4, srcSpan);
-            dstImg = Image(crop.size, 3);
-        } break;
-        case gli::FORMAT_BGRA8_UNORM_PACK8: {
-            compRemap = {MapTo::Blue, MapTo::Green, MapTo::Red, MapTo::Alpha};
-            srcImg = ImageRef(srcExtent, 4, srcSpan);
-            dstImg = Image(crop.size, 4);
-        } break;
-        // case gli::FORMAT_R16_SFLOAT_PACK16: {} break;
-        // case gli::FORMAT_R32_SFLOAT_PACK32: {} break;
-        // case gli::FORMAT_RG16_SFLOAT_PACK16: {} break;
-        case gli::FORMAT_RG8_UNORM_PACK8: {
-            compRemap = {MapTo::Red, MapTo::Green, MapTo::Zero, MapTo::One};
-            srcImg = ImageRef(srcExtent, 2, srcSpan);
-            dstImg = Image(crop.size, 3);
-        } break;
-        // case gli::FORMAT_RGBA32_SFLOAT_PACK32: {} break;
-        case gli::FORMAT_RGBA8_SRGB_PACK8:
-        case gli::FORMAT_RGBA8_UNORM_PACK8: {
-            srcImg = ImageRef(srcExtent, 4, srcSpan);
-            dstImg = Image(crop.size, 4);
-        } break;
-        default:
-            throw std::runtime_error(fmt::format("unhandled format {}: {}", fmt, srcPath));
+    }
+    if (args.size() != 2) {
+        throw std::runtime_error("invalid argument count");
+    }
+    std::string const &srcPath = args[0], &dstPath = args[1];
+    if (srcPath.size() < 4 || srcPath.substr(srcPath.size() - 4) != ".png") {
+        throw std::runtime_error(fmt::format("input image must be a PNG file: {}", srcPath));
+    }
+    if (dstPath.size() < 4 || dstPath.substr(dstPath.size() - 4) != ".dds") {
+        throw std::runtime_error(fmt::format("output image must be a DDS file: {}", dstPath));
+    }
+
+    Image img = DecodePng(ReadFile(srcPath), srcPath);
+    gli::format dstFormat = srgb ? format.srgb : format.unorm;
+    // Zero levels asks for the whole chain, down to 1x1.
+    int fullChain = 1;
+    while (std::max(img.extent.x, img.extent.y) >> fullChain) {
+        ++fullChain;
+    }
+    levels = levels == 0 ? fullChain : std::min(levels, fullChain);
+    std::vector<uint8_t> file = WriteDdsHeader(dstFormat, img.extent, levels);
+    size_t headerSize = file.size();
+    DdsTexture dds = *ParseDdsHeader(file);
+    file.resize(headerSize + dds.FaceSize());
+
+    // Progress goes to standard error about once a second, from whichever thread finishes a block row.
+    uint64_t totalBlocks = 0;
+    for (int level = 0; level < levels; ++level) {
+        glm::ivec2 extent = dds.LevelExtent(level);
+        totalBlocks += uint64_t((extent.x + 3) / 4) * ((extent.y + 3) / 4);
+    }
+    std::atomic<uint64_t> blocksDone{0};
+    std::mutex progressMutex;
+    auto startTime = std::chrono::steady_clock::now();
+    auto lastReport = startTime;
+    bool reported = false;
+    auto progress = [&](uint64_t blocks) {
+        uint64_t done = blocksDone += blocks;
+        std::unique_lock lk(progressMutex, std::try_to_lock);
+        auto now = std::chrono::steady_clock::now();
+        if (!lk || now - lastReport < std::chrono::seconds(1)) {
+            return;
         }
-        for (int row = 0; row < srcImg->extent.y; ++row) {
-            for (int col = 0; col < srcImg->extent.x; ++col) {
-                glm::ivec2 dstCoord{col, row};
-                auto *srcPixel = srcImg->GetPixel(crop.origin + dstCoord);
-                auto *dstPixel = dstImg->GetPixel(dstCoord);
-                for (int comp = 0; comp < dstImg->components; ++comp) {
-                    uint8_t val{};
-                    auto remap = compRemap[comp];
-                    switch (remap) {
-                    case MapTo::Red:
-                    case MapTo::Blue:
-                    case MapTo::Green:
-                    case MapTo::Alpha:
-                        val = srcPixel[(int)remap];
-                        break;
-                    case MapTo::One:
-                        val = 0xFF;
-                        break;
-                    case MapTo::Zero:
-                        val = 0x00;
-                        break;
-                    }
-                    dstPixel[comp] = val;
+        lastReport = now;
+        reported = true;
+        double seconds = std::chrono::duration<double>(now - startTime).count();
+        fprintf(stderr, "\rencoded %llu of %llu blocks (%.0f%%), %.0f blocks/s", (unsigned long long)done,
+                (unsigned long long)totalBlocks, 100.0 * done / totalBlocks, done / seconds);
+    };
+    {
+        ThreadPool pool(threadCount);
+        CompressMipChain(dstFormat, quality, img, levels, mipFilter, srgb, gsl::span<uint8_t>(file).subspan(headerSize),
+                         pool, progress);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    std::string formatName(GliFormatName(dstFormat));
+    fprintf(stderr, "%sencoded %dx%d with %d levels as %s in %.2f s (%.0f blocks/s)\n", reported ? "\n" : "",
+            img.extent.x, img.extent.y, levels, formatName.c_str(), seconds,
+            seconds > 0.0 ? totalBlocks / seconds : 0.0);
+    WriteFile(dstPath, file);
+}
+
+// Describes DDS files from their headers alone, for files given directly and all those found below directories.
+void InfoCommand(std::deque<std::string> args) {
+    namespace fs = std::filesystem;
+
+    unsigned threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+    InfoFormat format = InfoFormat::Jsonl;
+    std::optional<std::string> outputPath;
+    std::string root = ".";
+    std::optional<std::string> ggpkPath;
+    for (auto I = args.begin(); I != args.end();) {
+        if (*I == "--threads" || *I == "--format" || *I == "--output" || *I == "--root" || *I == "--ggpk") {
+            if (I + 1 == args.end()) {
+                throw std::runtime_error(fmt::format("missing value for option {}", *I));
+            }
+            if (*I == "--threads") {
+                threadCount = unsigned(std::max(1, IntoInt(I[1])));
+            } else if (*I == "--format") {
+                format = ParseInfoFormat(I[1]);
+            } else if (*I == "--root") {
+                root = I[1];
+            } else if (*I == "--ggpk") {
+                ggpkPath = I[1];
+            } else {
+                outputPath = I[1];
+            }
+            I = args.erase(I, I + 2);
+        } else {
+            ++I;
+        }
+    }
+    if (args.empty()) {
+        throw std::runtime_error("invalid argument count");
+    }
+
+    auto archive = OpenArchive(ggpkPath);
+    std::vector<std::string> paths;
+    for (auto &arg : args) {
+        if (archive && IsGgpkPath(arg) && !archive->Find(GgpkEntryPath(arg))) {
+            // Not a file in the archive, so a directory.
+            for (auto const *entry : archive->List(GgpkEntryPath(arg))) {
+                if (HasDdsExtension(entry->path)) {
+                    paths.push_back(fmt::format("{}{}", GgpkPrefix, entry->path));
                 }
             }
+        } else if (fs::is_directory(arg)) {
+            for (auto &entry : fs::recursive_directory_iterator(arg)) {
+                if (entry.is_regular_file() && HasDdsExtension(entry.path())) {
+                    paths.push_back(entry.path().generic_string());
+                }
+            }
+        } else {
+            paths.push_back(arg);
+        }
+    }
+    std::sort(paths.begin(), paths.end());
+
+    // Files are described in chunks on the pool, and the output of the chunks is written in order at the end.
+    constexpr size_t FilesPerChunk = 256;
+    std::vector<std::string> chunks((paths.size() + FilesPerChunk - 1) / FilesPerChunk);
+    std::atomic<size_t> failed{0};
+    std::mutex errorMutex;
+    PayloadResolver resolver(root, archive.get());
+
+    auto startTime = std::chrono::steady_clock::now();
+    {
+        ThreadPool pool(threadCount);
+        for (size_t chunk = 0; chunk < chunks.size(); ++chunk) {
+            pool.Submit([&, chunk] {
+                size_t end = std::min(paths.size(), (chunk + 1) * FilesPerChunk);
+                for (size_t i = chunk * FilesPerChunk; i < end; ++i) {
+                    try {
+                        chunks[chunk] += FormatTextureInfo(ReadTextureInfo(paths[i], resolver, archive.get()), format);
+                    } catch (std::exception &e) {
+                        ++failed;
+                        std::lock_guard lk(errorMutex);
+                        fprintf(stderr, "error: %s\n", e.what());
+                    }
+                }
+            });
         }
+        pool.Wait();
     }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
 
-    // At this point, we have R 8, RG 8.8, RGB 8.8.8 or RGBA 8.8.8.8 unsigned integer texture data
-    auto dstExtent = dstImg->extent;
-    int dstComp = dstImg->components;
-    uint8_t const *dstData = dstImg->GetPixel({0, 0});
-    int dstStride = dstImg->GetStride();
-    stbi_write_png(dstPath.c_str(), dstExtent.x, dstExtent.y, dstComp, dstData, dstStride);
+    std::unique_ptr<FILE, decltype(&fclose)> outFile(nullptr, &fclose);
+    if (outputPath) {
+        outFile.reset(fopen(outputPath->c_str(), "wb"));
+        if (!outFile) {
+            throw std::runtime_error(fmt::format("could not write file: {}", *outputPath));
+        }
+    }
+    FILE *out = outFile ? outFile.get() : stdout;
+    if (format == InfoFormat::Csv) {
+        fputs(InfoCsvHeader().c_str(), out);
+    }
+    for (auto &chunk : chunks) {
+        fwrite(chunk.data(), 1, chunk.size(), out);
+    }
+    if (fflush(out) != 0) {
+        throw std::runtime_error("could not write info output");
+    }
+
+    fprintf(stderr, "described %zu of %zu files in %.2f s (%.0f files/s)\n", paths.size() - failed, paths.size(),
+            seconds, seconds > 0.0 ? paths.size() / seconds : 0.0);
+    if (failed) {
+        throw std::runtime_error(fmt::format("{} files could not be described", failed.load()));
+    }
 }
 
 void PrintUsageAndExit(char const *progName) {
     fprintf(stderr, "usage:\n");
-    fprintf(stderr, "%s convert SRC.dds DST.png [x y w h]\n", progName);
+    fprintf(stderr,
+            "%s convert [--mip N | --max-size WxH] [--sizes N,...] [--filter lanczos|mitchell] [--root DIR] "
+            "[--ggpk FILE] [--stats table|json] [--trace PATH] [--force-isa LEVEL] SRC.dds|- DST.png|- [x y w h]\n",
+            progName);
+    fprintf(stderr,
+            "%s convert-tree [--manifest PATH] [--force] [pipeline options] [convert options] SRC_DIR DST_DIR\n",
+            progName);
+    fprintf(stderr, "%s batch [pipeline options] [convert options] LIST | - -\n", progName);
+    fprintf(stderr,
+            "%s encode [--format bc1|bc2|bc3|bc7] [--srgb] [--quality Q] [--levels N] [--mip-filter box|kaiser] "
+            "[--threads N] SRC.png DST.dds\n",
+            progName);
+    fprintf(stderr,
+            "%s info [--format jsonl|csv] [--output PATH] [--threads N] [--root DIR] [--ggpk FILE] PATH...\n",
+            progName);
+    fprintf(stderr, "pipeline options: [--threads N] [--read-threads N] [--decode-threads N] [--encode-threads N] "
+                    "[--write-threads N] [--queue-depth N] [--io auto|threads|io_uring] [--read-depth N]\n");
     exit(1);
 }
 
@@ -290,6 +569,14 @@ int main(int argc, char **argv) {
     try {
         if (cmd == "convert") {
             ConvertCommand(args);
+        } else if (cmd == "convert-tree") {
+            ConvertTreeCommand(args);
+        } else if (cmd == "batch") {
+            BatchCommand(args);
+        } else if (cmd == "encode") {
+            EncodeCommand(args);
+        } else if (cmd == "info") {
+            InfoCommand(args);
         } else {
             PrintUsageAndExit(argv[0]);
         }
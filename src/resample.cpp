@@ -0,0 +1,318 @@
+#include "resample.h"
+#include "cpu_features.h"
+#include "resample_kernels.h"
+#include "stats.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <map>
+
+namespace {
+constexpr float Pi = 3.14159265358979f;
+
+float Sinc(float x) {
+    if (x == 0.0f) {
+        return 1.0f;
+    }
+    x *= Pi;
+    return std::sin(x) / x;
+}
+
+float Lanczos3(float x) {
+    x = std::abs(x);
+    return x < 3.0f ? Sinc(x) * Sinc(x / 3.0f) : 0.0f;
+}
+
+// Mitchell-Netravali with B = C = 1/3.
+float Mitchell(float x) {
+    constexpr float B = 1.0f / 3.0f, C = 1.0f / 3.0f;
+    x = std::abs(x);
+    if (x < 1.0f) {
+        return ((12 - 9 * B - 6 * C) * x * x * x + (-18 + 12 * B + 6 * C) * x * x + (6 - 2 * B)) / 6.0f;
+    }
+    if (x < 2.0f) {
+        return ((-B - 6 * C) * x * x * x + (6 * B + 30 * C) * x * x + (-12 * B - 48 * C) * x + (8 * B + 24 * C)) /
+               6.0f;
+    }
+    return 0.0f;
+}
+
+float Box(float x) { return std::abs(x) <= 0.5f ? 1.0f : 0.0f; }
+
+// Modified Bessel function of the first kind and order zero, from its power series.
+float BesselI0(float x) {
+    float sum = 1.0f, term = 1.0f, quarter = x * x / 4.0f;
+    for (int k = 1; k < 20; ++k) {
+        term *= quarter / float(k * k);
+        sum += term;
+    }
+    return sum;
+}
+
+// Sinc under a Kaiser window with a radius of 3 and alpha = 4.
+float Kaiser(float x) {
+    constexpr float Radius = 3.0f, Alpha = 4.0f;
+    x = std::abs(x);
+    if (x >= Radius) {
+        return 0.0f;
+    }
+    float t = x / Radius;
+    return Sinc(x) * BesselI0(Alpha * std::sqrt(1.0f - t * t)) / BesselI0(Alpha);
+}
+
+ResampleTaps ComputeTaps(int srcLen, int dstLen, ResampleFilter filter) {
+    float (*kernel)(float) = Lanczos3;
+    float radius = 3.0f;
+    switch (filter) {
+    case ResampleFilter::Lanczos3:
+        break;
+    case ResampleFilter::Mitchell:
+        kernel = Mitchell;
+        radius = 2.0f;
+        break;
+    case ResampleFilter::Box:
+        kernel = Box;
+        radius = 0.5f;
+        break;
+    case ResampleFilter::Kaiser:
+        kernel = Kaiser;
+        break;
+    }
+
+    // When minifying, stretch the kernel to cover the source footprint of each output sample.
+    float scale = static_cast<float>(dstLen) / static_cast<float>(srcLen);
+    float kernelScale = std::min(scale, 1.0f);
+    float support = radius / kernelScale;
+
+    std::vector<std::map<int, float>> contributions(dstLen);
+    int widest = 1;
+    for (int i = 0; i < dstLen; ++i) {
+        float center = (i + 0.5f) / scale - 0.5f;
+        int lo = static_cast<int>(std::ceil(center - support));
+        int hi = static_cast<int>(std::floor(center + support));
+        float total = 0.0f;
+        for (int j = lo; j <= hi; ++j) {
+            float w = kernel((j - center) * kernelScale);
+            if (w != 0.0f) {
+                contributions[i][std::clamp(j, 0, srcLen - 1)] += w;
+                total += w;
+            }
+        }
+        if (contributions[i].empty() || total == 0.0f) {
+            contributions[i].clear();
+            contributions[i][std::clamp(static_cast<int>(std::lround(center)), 0, srcLen - 1)] = 1.0f;
+            total = 1.0f;
+        }
+        for (auto &[idx, w] : contributions[i]) {
+            w /= total;
+        }
+        int span = contributions[i].rbegin()->first - contributions[i].begin()->first + 1;
+        widest = std::max(widest, span);
+    }
+
+    ResampleTaps ret;
+    ret.taps = std::min(widest, srcLen);
+    ret.first.resize(dstLen);
+    ret.weights.assign(static_cast<size_t>(dstLen) * ret.taps, 0.0f);
+    for (int i = 0; i < dstLen; ++i) {
+        int first = std::min(contributions[i].begin()->first, srcLen - ret.taps);
+        ret.first[i] = first;
+        for (auto &[idx, w] : contributions[i]) {
+            ret.weights[static_cast<size_t>(i) * ret.taps + (idx - first)] = w;
+        }
+    }
+    return ret;
+}
+
+struct SrgbTables {
+    static constexpr int EncodeSteps = 16384;
+
+    SrgbTables() {
+        for (int i = 0; i < 256; ++i) {
+            float c = i / 255.0f;
+            decode[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+        for (int i = 0; i < EncodeSteps; ++i) {
+            float l = i / static_cast<float>(EncodeSteps - 1);
+            float c = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+            encode[i] = static_cast<uint8_t>(std::clamp(std::lround(c * 255.0f), 0l, 255l));
+        }
+    }
+
+    uint8_t Encode(float l) const {
+        l = std::clamp(l, 0.0f, 1.0f);
+        return encode[static_cast<int>(l * (EncodeSteps - 1) + 0.5f)];
+    }
+
+    std::array<float, 256> decode{};
+    std::array<uint8_t, EncodeSteps> encode{};
+};
+
+SrgbTables const &GetSrgbTables() {
+    static SrgbTables const tables;
+    return tables;
+}
+
+struct ResampleKernels {
+    ResampleKernels() {
+#ifdef PROCESS_IMAGE_SIMD
+        Isa isa = ActiveIsa();
+        if (isa >= Isa::Avx512) {
+            horizontal = ResampleHorizontalAvx512;
+            vertical = ResampleVerticalAvx512;
+        } else if (isa >= Isa::Avx2) {
+            horizontal = ResampleHorizontalAvx2;
+            vertical = ResampleVerticalAvx2;
+        }
+#endif
+    }
+
+    ResampleHorizontalFunc horizontal = ResampleHorizontalScalar;
+    ResampleVerticalFunc vertical = ResampleVerticalScalar;
+};
+
+ResampleKernels const &GetResampleKernels() {
+    static ResampleKernels const kernels;
+    return kernels;
+}
+} // namespace
+
+void ResampleHorizontalScalar(float const *src, ResampleTaps const &taps, float *dst) {
+    size_t outputs = taps.first.size();
+    for (size_t i = 0; i < outputs; ++i) {
+        float const *in = src + 4 * taps.first[i];
+        float const *w = taps.weights.data() + i * taps.taps;
+        float acc[4]{};
+        for (int k = 0; k < taps.taps; ++k) {
+            for (int c = 0; c < 4; ++c) {
+                acc[c] += w[k] * in[4 * k + c];
+            }
+        }
+        for (int c = 0; c < 4; ++c) {
+            dst[4 * i + c] = acc[c];
+        }
+    }
+}
+
+void ResampleVerticalScalar(float const *const *rows, float const *weights, int taps, int count, float *dst) {
+    for (int x = 0; x < count; ++x) {
+        dst[x] = weights[0] * rows[0][x];
+    }
+    for (int k = 1; k < taps; ++k) {
+        float w = weights[k];
+        float const *row = rows[k];
+        for (int x = 0; x < count; ++x) {
+            dst[x] += w * row[x];
+        }
+    }
+}
+
+std::optional<ResampleFilter> ParseResampleFilter(std::string_view name) {
+    if (name == "lanczos") {
+        return ResampleFilter::Lanczos3;
+    }
+    if (name == "mitchell") {
+        return ResampleFilter::Mitchell;
+    }
+    return {};
+}
+
+glm::ivec2 FitExtent(glm::ivec2 extent, int size) {
+    int longest = std::max(extent.x, extent.y);
+    auto scaled = [&](int len) { return std::max(1, static_cast<int>(std::lround(double(len) * size / longest))); };
+    return glm::ivec2(scaled(extent.x), scaled(extent.y));
+}
+
+Image Resample(ImageRef const &src, glm::ivec2 dstExtent, ResampleFilter filter) {
+    PhaseTimer timer(Phase::Resample);
+    auto const &srgb = GetSrgbTables();
+    auto const &kernels = GetResampleKernels();
+    int const comps = src.components;
+    bool const hasAlpha = comps == 2 || comps == 4;
+    int const colorComps = hasAlpha ? comps - 1 : comps;
+
+    ResampleTaps horizontal = ComputeTaps(src.extent.x, dstExtent.x, filter);
+    ResampleTaps vertical = ComputeTaps(src.extent.y, dstExtent.y, filter);
+
+    // Horizontal pass over every source row, expanding to linear premultiplied RGBA floats first.
+    size_t const midStride = 4 * static_cast<size_t>(dstExtent.x);
+    PixelBuffer midBuffer(midStride * src.extent.y * sizeof(float));
+    float *mid = reinterpret_cast<float *>(midBuffer.data());
+    std::vector<float> srcRow(4 * static_cast<size_t>(src.extent.x));
+    for (int row = 0; row < src.extent.y; ++row) {
+        uint8_t const *in = src.GetPixel({0, row});
+        for (int col = 0; col < src.extent.x; ++col, in += comps) {
+            float *px = &srcRow[4 * col];
+            float alpha = hasAlpha ? in[comps - 1] / 255.0f : 1.0f;
+            for (int c = 0; c < 3; ++c) {
+                px[c] = c < colorComps ? srgb.decode[in[c]] * alpha : 0.0f;
+            }
+            px[3] = alpha;
+        }
+        kernels.horizontal(srcRow.data(), horizontal, mid + row * midStride);
+    }
+
+    // Vertical pass, then back to straight alpha and sRGB bytes.
+    Image dst(dstExtent, comps);
+    std::vector<float> dstRow(midStride);
+    std::vector<float const *> rows(vertical.taps);
+    for (int row = 0; row < dstExtent.y; ++row) {
+        for (int k = 0; k < vertical.taps; ++k) {
+            rows[k] = mid + (vertical.first[row] + k) * midStride;
+        }
+        kernels.vertical(rows.data(), vertical.weights.data() + static_cast<size_t>(row) * vertical.taps,
+                         vertical.taps, static_cast<int>(midStride), dstRow.data());
+        uint8_t *out = dst.GetPixel({0, row});
+        for (int col = 0; col < dstExtent.x; ++col, out += comps) {
+            float const *px = &dstRow[4 * col];
+            float alpha = std::clamp(px[3], 0.0f, 1.0f);
+            float unpremultiply = hasAlpha && alpha > 0.0f ? 1.0f / alpha : 1.0f;
+            for (int c = 0; c < colorComps; ++c) {
+                out[c] = srgb.Encode(px[c] * unpremultiply);
+            }
+            if (hasAlpha) {
+                out[comps - 1] = static_cast<uint8_t>(std::lround(alpha * 255.0f));
+            }
+        }
+    }
+    return dst;
+}
+
+void ToLinearRgba(uint8_t const *src, int count, bool srgb, float *dst) {
+    auto const &tables = GetSrgbTables();
+    for (int i = 0; i < count; ++i, src += 4, dst += 4) {
+        float alpha = src[3] / 255.0f;
+        for (int c = 0; c < 3; ++c) {
+            dst[c] = (srgb ? tables.decode[src[c]] : src[c] / 255.0f) * alpha;
+        }
+        dst[3] = alpha;
+    }
+}
+
+void FromLinearRgba(float const *src, int count, bool srgb, uint8_t *dst) {
+    auto const &tables = GetSrgbTables();
+    for (int i = 0; i < count; ++i, src += 4, dst += 4) {
+        float alpha = std::clamp(src[3], 0.0f, 1.0f);
+        float unpremultiply = alpha > 0.0f ? 1.0f / alpha : 1.0f;
+        for (int c = 0; c < 3; ++c) {
+            float value = src[c] * unpremultiply;
+            dst[c] = srgb ? tables.Encode(value)
+                          : static_cast<uint8_t>(std::lround(std::clamp(value, 0.0f, 1.0f) * 255.0f));
+        }
+        dst[3] = static_cast<uint8_t>(std::lround(alpha * 255.0f));
+    }
+}
+
+MipStep::MipStep(glm::ivec2 srcExtent, glm::ivec2 dstExtent, ResampleFilter filter)
+    : extent(dstExtent), horizontal(ComputeTaps(srcExtent.x, dstExtent.x, filter)),
+      vertical(ComputeTaps(srcExtent.y, dstExtent.y, filter)) {}
+
+void MipStep::FilterAcross(float const *src, float *dst) const {
+    GetResampleKernels().horizontal(src, horizontal, dst);
+}
+
+void MipStep::FilterDown(int row, float const *const *rows, float *dst) const {
+    GetResampleKernels().vertical(rows, vertical.weights.data() + static_cast<size_t>(row) * vertical.taps,
+                                  vertical.taps, 4 * extent.x, dst);
+}
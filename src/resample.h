@@ -0,0 +1,58 @@
+#ifndef RESAMPLE_H
+#define RESAMPLE_H
+
+#include <optional>
+#include <string_view>
+
+#include "image.h"
+#include "resample_kernels.h"
+
+enum class ResampleFilter {
+    Lanczos3,
+    Mitchell,
+    // Averages the source footprint of each output pixel, a plain 2x2 average when halving.
+    Box,
+    // Sinc with a Kaiser window, sharper than a box and with less ringing than Lanczos.
+    Kaiser,
+};
+
+std::optional<ResampleFilter> ParseResampleFilter(std::string_view name);
+
+// Largest extent with the aspect ratio of `extent` that fits in a `size` by `size` square.
+glm::ivec2 FitExtent(glm::ivec2 extent, int size);
+
+// Resamples an 8-bit sRGB image to a new extent with a separable filter. Filtering happens in linear light with
+// premultiplied alpha; for images with 2 or 4 components the last component is taken to be linear alpha.
+Image Resample(ImageRef const &src, glm::ivec2 dstExtent, ResampleFilter filter);
+
+// Expands RGBA8 pixels to linear floats with premultiplied alpha, decoding the colour from sRGB if `srgb` is set.
+void ToLinearRgba(uint8_t const *src, int count, bool srgb, float *dst);
+
+// Turns linear premultiplied RGBA floats back into RGBA8 with straight alpha, encoding the colour to sRGB if `srgb` is
+// set.
+void FromLinearRgba(float const *src, int count, bool srgb, uint8_t *dst);
+
+// One step down a mip chain, filtering a level of linear premultiplied RGBA floats to a smaller extent a row at a
+// time. Rows of the larger level are filtered across as they are made, and each row of the smaller level is filtered
+// down from the Taps() rows after FirstRow(row) once they have been, so that callers only need to keep that many rows
+// around, while they are still in cache. Holds no rows itself, and is safe to use from several threads at once.
+class MipStep {
+  public:
+    MipStep(glm::ivec2 srcExtent, glm::ivec2 dstExtent, ResampleFilter filter);
+
+    glm::ivec2 Extent() const { return extent; }
+    int Taps() const { return vertical.taps; }
+    int FirstRow(int row) const { return vertical.first[row]; }
+
+    // Filters a row of the larger level across into 4 * Extent().x floats.
+    void FilterAcross(float const *src, float *dst) const;
+
+    // Makes row `row` of the smaller level from `rows`, the Taps() rows from FirstRow(row) on after filtering across.
+    void FilterDown(int row, float const *const *rows, float *dst) const;
+
+  private:
+    glm::ivec2 extent;
+    ResampleTaps horizontal, vertical;
+};
+
+#endif // RESAMPLE_H
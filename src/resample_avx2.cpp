@@ -0,0 +1,45 @@
+#include "resample_kernels.h"
+
+#include <immintrin.h>
+
+// This translation unit is built with AVX2 and FMA enabled and must only be entered after a CPU check.
+
+void ResampleHorizontalAvx2(float const *src, ResampleTaps const &taps, float *dst) {
+    size_t outputs = taps.first.size();
+    for (size_t i = 0; i < outputs; ++i) {
+        float const *in = src + 4 * taps.first[i];
+        float const *w = taps.weights.data() + i * taps.taps;
+
+        // Two source pixels per iteration, each lane half weighted by its own tap.
+        __m256 acc = _mm256_setzero_ps();
+        int k = 0;
+        for (; k + 2 <= taps.taps; k += 2) {
+            __m256 px = _mm256_loadu_ps(in + 4 * k);
+            __m256 wk = _mm256_set_m128(_mm_set1_ps(w[k + 1]), _mm_set1_ps(w[k]));
+            acc = _mm256_fmadd_ps(px, wk, acc);
+        }
+        __m128 sum = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+        if (k < taps.taps) {
+            sum = _mm_fmadd_ps(_mm_loadu_ps(in + 4 * k), _mm_set1_ps(w[k]), sum);
+        }
+        _mm_storeu_ps(dst + 4 * i, sum);
+    }
+}
+
+void ResampleVerticalAvx2(float const *const *rows, float const *weights, int taps, int count, float *dst) {
+    int x = 0;
+    for (; x + 8 <= count; x += 8) {
+        __m256 acc = _mm256_mul_ps(_mm256_set1_ps(weights[0]), _mm256_loadu_ps(rows[0] + x));
+        for (int k = 1; k < taps; ++k) {
+            acc = _mm256_fmadd_ps(_mm256_set1_ps(weights[k]), _mm256_loadu_ps(rows[k] + x), acc);
+        }
+        _mm256_storeu_ps(dst + x, acc);
+    }
+    for (; x < count; ++x) {
+        float acc = weights[0] * rows[0][x];
+        for (int k = 1; k < taps; ++k) {
+            acc += weights[k] * rows[k][x];
+        }
+        dst[x] = acc;
+    }
+}
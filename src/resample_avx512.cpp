@@ -0,0 +1,51 @@
+#include "resample_kernels.h"
+
+#include <immintrin.h>
+
+// This translation unit is built with AVX-512 and FMA enabled and must only be entered after a CPU check.
+
+void ResampleHorizontalAvx512(float const *src, ResampleTaps const &taps, float *dst) {
+    // Spreads four weights over the four pixels of a register, one weight per pixel.
+    __m512i const spread = _mm512_set_epi32(3, 3, 3, 3, 2, 2, 2, 2, 1, 1, 1, 1, 0, 0, 0, 0);
+    size_t outputs = taps.first.size();
+    for (size_t i = 0; i < outputs; ++i) {
+        float const *in = src + 4 * taps.first[i];
+        float const *w = taps.weights.data() + i * taps.taps;
+
+        // Four source pixels per iteration, each lane quarter weighted by its own tap.
+        __m512 acc = _mm512_setzero_ps();
+        int k = 0;
+        for (; k + 4 <= taps.taps; k += 4) {
+            __m512 px = _mm512_loadu_ps(in + 4 * k);
+            __m512 wk = _mm512_permutexvar_ps(spread, _mm512_castps128_ps512(_mm_loadu_ps(w + k)));
+            acc = _mm512_fmadd_ps(px, wk, acc);
+        }
+        __m256 half = _mm256_add_ps(_mm512_castps512_ps256(acc),
+                                    _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(acc), 1)));
+        __m128 sum = _mm_add_ps(_mm256_castps256_ps128(half), _mm256_extractf128_ps(half, 1));
+        for (; k < taps.taps; ++k) {
+            sum = _mm_fmadd_ps(_mm_loadu_ps(in + 4 * k), _mm_set1_ps(w[k]), sum);
+        }
+        _mm_storeu_ps(dst + 4 * i, sum);
+    }
+}
+
+void ResampleVerticalAvx512(float const *const *rows, float const *weights, int taps, int count, float *dst) {
+    int x = 0;
+    for (; x + 16 <= count; x += 16) {
+        __m512 acc = _mm512_mul_ps(_mm512_set1_ps(weights[0]), _mm512_loadu_ps(rows[0] + x));
+        for (int k = 1; k < taps; ++k) {
+            acc = _mm512_fmadd_ps(_mm512_set1_ps(weights[k]), _mm512_loadu_ps(rows[k] + x), acc);
+        }
+        _mm512_storeu_ps(dst + x, acc);
+    }
+    if (x < count) {
+        // The rest of the row through a mask, rather than a scalar loop of up to 15 floats.
+        __mmask16 mask = static_cast<__mmask16>((1u << (count - x)) - 1);
+        __m512 acc = _mm512_mul_ps(_mm512_set1_ps(weights[0]), _mm512_maskz_loadu_ps(mask, rows[0] + x));
+        for (int k = 1; k < taps; ++k) {
+            acc = _mm512_fmadd_ps(_mm512_set1_ps(weights[k]), _mm512_maskz_loadu_ps(mask, rows[k] + x), acc);
+        }
+        _mm512_mask_storeu_ps(dst + x, mask, acc);
+    }
+}
@@ -0,0 +1,31 @@
+#ifndef RESAMPLE_KERNELS_H
+#define RESAMPLE_KERNELS_H
+
+#include <vector>
+
+// Filter taps for one axis. Every output sample reads exactly `taps` consecutive source samples starting at
+// `first[i]`, with zero weights padding out windows that are narrower than the widest one.
+struct ResampleTaps {
+    int taps{};
+    std::vector<int> first;
+    std::vector<float> weights;
+};
+
+// Kernels work on RGBA pixels of four floats each.
+//
+// Horizontal: dst[i] = sum_k weights[i * taps + k] * src[first[i] + k] for every output pixel i.
+// Vertical: dst[x] = sum_k weights[k] * rows[k][x] for `count` floats.
+using ResampleHorizontalFunc = void (*)(float const *src, ResampleTaps const &taps, float *dst);
+using ResampleVerticalFunc = void (*)(float const *const *rows, float const *weights, int taps, int count, float *dst);
+
+void ResampleHorizontalScalar(float const *src, ResampleTaps const &taps, float *dst);
+void ResampleVerticalScalar(float const *const *rows, float const *weights, int taps, int count, float *dst);
+
+#ifdef PROCESS_IMAGE_SIMD
+void ResampleHorizontalAvx2(float const *src, ResampleTaps const &taps, float *dst);
+void ResampleVerticalAvx2(float const *const *rows, float const *weights, int taps, int count, float *dst);
+void ResampleHorizontalAvx512(float const *src, ResampleTaps const &taps, float *dst);
+void ResampleVerticalAvx512(float const *const *rows, float const *weights, int taps, int count, float *dst);
+#endif
+
+#endif // RESAMPLE_KERNELS_H
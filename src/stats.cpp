@@ -0,0 +1,195 @@
+#include "stats.h"
+
+#include <array>
+#include <chrono>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+
+#include <fmt/core.h>
+
+#include "cpu_features.h"
+#include "gli_format_names.h"
+#include "info.h"
+#include "trace.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <time.h>
+#endif
+
+std::atomic<bool> statsEnabled{false};
+
+namespace {
+struct PhaseTotals {
+    std::atomic<uint64_t> calls{0};
+    std::atomic<int64_t> wallNs{0};
+    std::atomic<int64_t> cpuNs{0};
+};
+
+constexpr char const *PhaseNames[] = {"read", "unpack", "load", "decode", "remap", "resample", "encode", "write"};
+static_assert(std::size(PhaseNames) == size_t(Phase::Count));
+
+std::array<PhaseTotals, size_t(Phase::Count)> phases;
+std::atomic<uint64_t> bytesRead{0}, pngCount{0}, pngBytes{0};
+struct BlockTotals {
+    uint64_t count{};
+    int64_t wallNs{};
+};
+
+std::mutex blocksMutex;
+std::map<gli::format, BlockTotals> blocks;
+
+int64_t WallNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+int64_t ThreadCpuNs() {
+#ifdef _WIN32
+    FILETIME creation, exit, kernel, user;
+    if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user)) {
+        return 0;
+    }
+    auto ticks = [](FILETIME t) { return int64_t(t.dwHighDateTime) << 32 | t.dwLowDateTime; };
+    return (ticks(kernel) + ticks(user)) * 100;
+#else
+    timespec ts{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return int64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+// Per thread, as the time is summed over the threads decoding.
+double BlocksPerSecond(BlockTotals const &totals) { return totals.wallNs ? totals.count * 1e9 / totals.wallNs : 0.0; }
+
+uint64_t PeakRssBytes() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters{};
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return 0;
+    }
+    return counters.PeakWorkingSetSize;
+#else
+    rusage usage{};
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#ifdef __APPLE__
+    return uint64_t(usage.ru_maxrss);
+#else
+    return uint64_t(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+} // namespace
+
+StatsFormat ParseStatsFormat(std::string_view name) {
+    if (name == "table") {
+        return StatsFormat::Table;
+    }
+    if (name == "json") {
+        return StatsFormat::Json;
+    }
+    throw std::runtime_error(fmt::format("unknown stats format, expected table or json: {}", name));
+}
+
+void EnableStats() { statsEnabled = true; }
+
+void PhaseTimer::Start() {
+    started = true;
+    wallStart = WallNs();
+    if (StatsEnabled()) {
+        cpuStart = ThreadCpuNs();
+    }
+}
+
+void PhaseTimer::Stop() {
+    int64_t wallEnd = WallNs();
+    if (StatsEnabled()) {
+        auto &totals = phases[size_t(phase)];
+        ++totals.calls;
+        totals.wallNs += wallEnd - wallStart;
+        totals.cpuNs += ThreadCpuNs() - cpuStart;
+    }
+    RecordSpan(PhaseNames[size_t(phase)], wallStart, wallEnd);
+}
+
+void CountBytesRead(uint64_t bytes) {
+    if (StatsEnabled()) {
+        bytesRead += bytes;
+    }
+}
+
+void BlockTimer::Start() {
+    started = true;
+    wallStart = WallNs();
+}
+
+void BlockTimer::Stop() {
+    int64_t wallNs = WallNs() - wallStart;
+    std::lock_guard lk(blocksMutex);
+    auto &totals = blocks[format];
+    totals.count += count;
+    totals.wallNs += wallNs;
+}
+
+void CountPng(uint64_t bytes) {
+    if (StatsEnabled()) {
+        ++pngCount;
+        pngBytes += bytes;
+    }
+}
+
+std::string FormatStats(StatsFormat format) {
+    std::lock_guard lk(blocksMutex);
+    uint64_t peakRss = PeakRssBytes();
+    std::string ret;
+    if (format == StatsFormat::Json) {
+        ret = "{\"phases\": {";
+        for (size_t i = 0; i < phases.size(); ++i) {
+            ret += fmt::format("{}\"{}\": {{\"calls\": {}, \"wall_s\": {:.6f}, \"cpu_s\": {:.6f}}}", i ? ", " : "",
+                               PhaseNames[i], phases[i].calls.load(), phases[i].wallNs / 1e9, phases[i].cpuNs / 1e9);
+        }
+        ret += fmt::format("}}, \"bytes_read\": {}, \"blocks\": {{", bytesRead.load());
+        char const *sep = "";
+        for (auto &[blockFormat, totals] : blocks) {
+            ret += fmt::format("{}{}: {}", sep, JsonString(GliFormatName(blockFormat)), totals.count);
+            sep = ", ";
+        }
+        ret += "}, \"blocks_per_s\": {";
+        sep = "";
+        for (auto &[blockFormat, totals] : blocks) {
+            ret += fmt::format("{}{}: {:.0f}", sep, JsonString(GliFormatName(blockFormat)), BlocksPerSecond(totals));
+            sep = ", ";
+        }
+        ret += fmt::format("}}, \"png_files\": {}, \"png_bytes\": {}, \"peak_rss_bytes\": {}, \"isa\": \"{}\"}}\n",
+                           pngCount.load(), pngBytes.load(), peakRss, IsaName(ActiveIsa()));
+        return ret;
+    }
+
+    // Time is summed over threads, so wall time can add up to more than the run took.
+    ret = fmt::format("{:<10} {:>9} {:>10} {:>10}\n", "phase", "calls", "wall s", "cpu s");
+    for (size_t i = 0; i < phases.size(); ++i) {
+        if (phases[i].calls) {
+            ret += fmt::format("{:<10} {:>9} {:>10.3f} {:>10.3f}\n", PhaseNames[i], phases[i].calls.load(),
+                               phases[i].wallNs / 1e9, phases[i].cpuNs / 1e9);
+        }
+    }
+    ret += fmt::format("bytes read: {}\n", bytesRead.load());
+    for (auto &[blockFormat, totals] : blocks) {
+        ret += fmt::format("blocks {}: {}, {:.0f}/s per thread\n", GliFormatName(blockFormat), totals.count,
+                           BlocksPerSecond(totals));
+    }
+    ret += fmt::format("png: {} files, {} bytes\n", pngCount.load(), pngBytes.load());
+    ret += fmt::format("peak rss: {:.1f} MiB\n", peakRss / double(1 << 20));
+    ret += fmt::format("kernels: {}\n", IsaName(ActiveIsa()));
+    return ret;
+}
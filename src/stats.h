@@ -0,0 +1,108 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include <gli/format.hpp>
+
+#include "trace.h"
+
+// Parts of a conversion that --stats accounts time to, and the spans that --trace records.
+enum class Phase {
+    // Reading source files and frames, including waits for asynchronous reads.
+    Read,
+    // Decompressing game payloads.
+    Unpack,
+    // Parsing the DDS header, or loading the file through gli when the native parser does not know it.
+    Load,
+    // Decompressing blocks.
+    Decode,
+    // Swizzling and expanding uncompressed texels.
+    Remap,
+    Resample,
+    // Compressing PNG.
+    Encode,
+    Write,
+    Count,
+};
+
+enum class StatsFormat {
+    Table,
+    Json,
+};
+
+// Parses "table" or "json".
+StatsFormat ParseStatsFormat(std::string_view name);
+
+extern std::atomic<bool> statsEnabled;
+
+// Nothing is collected until stats are enabled, and until then recording costs a relaxed load and a branch.
+inline bool StatsEnabled() { return statsEnabled.load(std::memory_order_relaxed); }
+void EnableStats();
+
+// Adds the wall clock and thread CPU time from construction to destruction to a phase, and records the span when
+// tracing.
+class PhaseTimer {
+  public:
+    explicit PhaseTimer(Phase phase) : phase(phase) {
+        if (StatsEnabled() || TraceEnabled()) {
+            Start();
+        }
+    }
+    ~PhaseTimer() {
+        if (started) {
+            Stop();
+        }
+    }
+
+    PhaseTimer(PhaseTimer const &) = delete;
+    PhaseTimer &operator=(PhaseTimer const &) = delete;
+
+  private:
+    void Start();
+    void Stop();
+
+    Phase phase;
+    bool started{};
+    int64_t wallStart{};
+    int64_t cpuStart{};
+};
+
+// Counts blocks of a format decoded from construction to destruction, and the wall time taken, for the throughput of
+// each format.
+class BlockTimer {
+  public:
+    BlockTimer(gli::format format, uint64_t count) : format(format), count(count) {
+        if (StatsEnabled()) {
+            Start();
+        }
+    }
+    ~BlockTimer() {
+        if (started) {
+            Stop();
+        }
+    }
+
+    BlockTimer(BlockTimer const &) = delete;
+    BlockTimer &operator=(BlockTimer const &) = delete;
+
+  private:
+    void Start();
+    void Stop();
+
+    gli::format format;
+    uint64_t count;
+    bool started{};
+    int64_t wallStart{};
+};
+
+void CountBytesRead(uint64_t bytes);
+void CountPng(uint64_t bytes);
+
+// Everything collected so far and the peak memory use of the process, with a trailing newline.
+std::string FormatStats(StatsFormat format);
+
+#endif // STATS_H
@@ -0,0 +1,39 @@
+#include "swizzle.h"
+
+#include "cpu_features.h"
+
+SwizzleRowFunc GetSwizzleRowFunc() {
+    static SwizzleRowFunc const func = [] {
+#ifdef PROCESS_IMAGE_SIMD
+        Isa isa = ActiveIsa();
+        if (isa >= Isa::Avx2) {
+            return SwizzleRowAvx2;
+        }
+        if (isa >= Isa::Ssse3) {
+            return SwizzleRowSsse3;
+        }
+#endif
+        return SwizzleRowScalar;
+    }();
+    return func;
+}
+
+void SwizzleRowScalar(uint8_t const *src, uint8_t *dst, int pixels, Swizzle const &swizzle) {
+    for (int i = 0; i < pixels; ++i) {
+        for (int comp = 0; comp < swizzle.dstComps; ++comp) {
+            int8_t from = swizzle.map[comp];
+            dst[comp] = from >= 0 ? src[from] : from == SwizzleOne ? 0xFF : 0x00;
+        }
+        src += swizzle.srcComps;
+        dst += swizzle.dstComps;
+    }
+}
+
+void SwizzleShuffle(Swizzle const &swizzle, uint8_t (&shuffle)[16], uint8_t (&fill)[16]) {
+    for (int i = 0; i < 16; ++i) {
+        int pixel = i / swizzle.dstComps, comp = i % swizzle.dstComps;
+        int8_t from = pixel < 4 ? swizzle.map[comp] : SwizzleZero;
+        shuffle[i] = from >= 0 ? uint8_t(pixel * swizzle.srcComps + from) : 0x80;
+        fill[i] = pixel < 4 && from == SwizzleOne ? 0xFF : 0x00;
+    }
+}
@@ -0,0 +1,35 @@
+#ifndef SWIZZLE_H
+#define SWIZZLE_H
+
+#include <array>
+#include <cstdint>
+
+// Output components that are not copied from the input pixel.
+constexpr int8_t SwizzleZero = -1;
+constexpr int8_t SwizzleOne = -2;
+
+// Reorders, drops and fills in the 8-bit components of pixels, from pixels of `srcComps` bytes to pixels of
+// `dstComps` bytes, both between 1 and 4. Output component c is input component map[c], or a constant.
+struct Swizzle {
+    int srcComps{4};
+    int dstComps{4};
+    std::array<int8_t, 4> map{0, 1, 2, 3};
+};
+
+using SwizzleRowFunc = void (*)(uint8_t const *src, uint8_t *dst, int pixels, Swizzle const &swizzle);
+
+// The variant for the active instruction set level, picked on first use.
+SwizzleRowFunc GetSwizzleRowFunc();
+
+void SwizzleRowScalar(uint8_t const *src, uint8_t *dst, int pixels, Swizzle const &swizzle);
+
+// Byte shuffle that swizzles four pixels held in 16 bytes, with 0x80 for output bytes that start out zero, and the
+// bytes to OR in afterwards for components that are one.
+void SwizzleShuffle(Swizzle const &swizzle, uint8_t (&shuffle)[16], uint8_t (&fill)[16]);
+
+#ifdef PROCESS_IMAGE_SIMD
+void SwizzleRowSsse3(uint8_t const *src, uint8_t *dst, int pixels, Swizzle const &swizzle);
+void SwizzleRowAvx2(uint8_t const *src, uint8_t *dst, int pixels, Swizzle const &swizzle);
+#endif
+
+#endif // SWIZZLE_H
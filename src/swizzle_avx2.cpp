@@ -0,0 +1,38 @@
+#include "swizzle.h"
+
+#include <algorithm>
+
+#include <immintrin.h>
+
+// This translation unit is built with AVX2 and FMA enabled and must only be entered after a CPU check.
+
+void SwizzleRowAvx2(uint8_t const *src, uint8_t *dst, int pixels, Swizzle const &swizzle) {
+    alignas(16) uint8_t shuffleBytes[16], fillBytes[16];
+    SwizzleShuffle(swizzle, shuffleBytes, fillBytes);
+    // The byte shuffle stays within 128-bit lanes, so each lane swizzles four pixels of its own.
+    __m256i shuffle = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<__m128i const *>(shuffleBytes)));
+    __m256i fill = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<__m128i const *>(fillBytes)));
+
+    // Eight pixels per step, as two groups of four that are loaded and stored with 16 bytes each, the second store
+    // overwriting what the first wrote past its pixels. The last pixels of the row, where 16 bytes would run past its
+    // end, are left to the scalar loop.
+    int const srcComps = swizzle.srcComps, dstComps = swizzle.dstComps;
+    int narrowest = std::min(srcComps, dstComps);
+    int reach = 4 + (16 + narrowest - 1) / narrowest;
+    int i = 0;
+    for (; i + reach <= pixels; i += 8) {
+        uint8_t const *in = src + i * srcComps;
+        uint8_t *out = dst + i * dstComps;
+        __m256i px = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<__m128i const *>(in))),
+            _mm_loadu_si128(reinterpret_cast<__m128i const *>(in + 4 * srcComps)), 1);
+        px = _mm256_or_si256(_mm256_shuffle_epi8(px, shuffle), fill);
+        if (dstComps == 4) {
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(out), px);
+        } else {
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out), _mm256_castsi256_si128(px));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 4 * dstComps), _mm256_extracti128_si256(px, 1));
+        }
+    }
+    SwizzleRowScalar(src + i * srcComps, dst + i * dstComps, pixels - i, swizzle);
+}
@@ -0,0 +1,27 @@
+#include "swizzle.h"
+
+#include <algorithm>
+
+#include <immintrin.h>
+
+// This translation unit is built with SSSE3 enabled and must only be entered after a CPU check.
+
+void SwizzleRowSsse3(uint8_t const *src, uint8_t *dst, int pixels, Swizzle const &swizzle) {
+    alignas(16) uint8_t shuffleBytes[16], fillBytes[16];
+    SwizzleShuffle(swizzle, shuffleBytes, fillBytes);
+    __m128i shuffle = _mm_load_si128(reinterpret_cast<__m128i const *>(shuffleBytes));
+    __m128i fill = _mm_load_si128(reinterpret_cast<__m128i const *>(fillBytes));
+
+    // Four pixels per step, each step loading and storing 16 bytes. Bytes stored past the four output pixels are
+    // overwritten by the next step, and the last pixels of the row, where 16 bytes would run past its end, are left
+    // to the scalar loop.
+    int narrowest = std::min(swizzle.srcComps, swizzle.dstComps);
+    int reach = (16 + narrowest - 1) / narrowest;
+    int i = 0;
+    for (; i + reach <= pixels; i += 4) {
+        __m128i in = _mm_loadu_si128(reinterpret_cast<__m128i const *>(src + i * swizzle.srcComps));
+        __m128i out = _mm_or_si128(_mm_shuffle_epi8(in, shuffle), fill);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * swizzle.dstComps), out);
+    }
+    SwizzleRowScalar(src + i * swizzle.srcComps, dst + i * swizzle.dstComps, pixels - i, swizzle);
+}
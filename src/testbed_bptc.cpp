@@ -1,20 +1,34 @@
+// Differential verification of lv_bptc against CMP_Core. Every BC7 block of every texture found is decoded by both,
+// in parallel over the files, and the time each decoder took is reported side by side. Blocks that decode differently
+// are counted per mode and collected into a reproducer texture that can be fed back in.
+
 #include "lv_bptc.h"
-#include <gli/texture2d.hpp>
-#include <gli/load.hpp>
 
 #include "cmp_core.h"
-
-#define STB_IMAGE_IMPLEMENTATION
-#include <stb_image.h>
+#include "convert.h"
+#include "dds.h"
+#include "payload.h"
+#include "thread_pool.h"
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <set>
 #include <string>
+#include <thread>
+#include <tuple>
 #include <vector>
 
+#include <fmt/core.h>
+
 std::map<gli::format, char const *> known_formats{
     {gli::FORMAT_UNDEFINED, "FORMAT_UNDEFINED"},
     {gli::FORMAT_RG4_UNORM_PACK8, "FORMAT_RG4_UNORM_PACK8"},
@@ -228,138 +242,368 @@ std::map<gli::format, char const *> known_formats{
     {gli::FORMAT_RG3B2_UNORM_PACK8, "FORMAT_RG3B2_UNORM_PACK8"},
 };
 
-int main(int argc, char **argv) {
-    if (argc != 2) {
-        return 1;
-    }
-    std::string srcPath = argv[1];
 
-    gli::texture2d srcTex{gli::load(srcPath)};
+// The eight modes and the reserved mode with no bit set.
+constexpr int ModeCount = 9;
+// Blocks decoded by one decoder before switching to the other, small enough for both to find them in cache.
+constexpr size_t ChunkBlocks = 4096;
+constexpr size_t MaxReproducerBlocks = 4096;
 
-    gli::format fmt = srcTex.format();
-    for (auto &[fmt, txt] : known_formats) {
-        // fprintf(stderr, "%d: %s\n", fmt, txt);
+using Clock = std::chrono::steady_clock;
+
+static int block_mode(uint8_t const *block) {
+    int mode = 0;
+    while (mode < 8 && !(block[0] & (1 << mode))) {
+        ++mode;
     }
-    // if (fmt != gli::FORMAT_RGBA_BP_UNORM_BLOCK16 && fmt != gli::FORMAT_RGBA_BP_SRGB_BLOCK16) {
-    {
-        if (auto I = known_formats.find(fmt); I != known_formats.end()) {
-            fprintf(stderr, "unhandled known format %s (%d): %s\n", I->second, fmt, srcPath.c_str());
-        } else {
-            fprintf(stderr, "unhandled unknown format %d: %s\n", fmt, srcPath.c_str());
+    return mode;
+}
+
+static void print_block_header(FILE *fh, uint8_t mode) {
+    struct BC7Mode {
+        int mode;
+        int subsets;
+        int partition_bits;
+        int rotation_bits;
+        int index_selection_bits;
+        int color_bits;
+        int alpha_bits;
+        int endpoint_p_bits;
+        int shared_p_bits;
+        int index_bits_per_element;
+        int secondary_index_bits_per_element;
+    } bc7_modes[] = {
+        // Mode NS PB RB ISB CB AB EPB SPB IB IB2
+        // ---- -- -- -- --- -- -- --- --- -- ---
+        {0, 3, 4, 0, 0, 4, 0, 1, 0, 3, 0}, {1, 2, 6, 0, 0, 6, 0, 0, 1, 3, 0}, {2, 3, 6, 0, 0, 5, 0, 0, 0, 2, 0},
+        {3, 2, 6, 0, 0, 7, 0, 1, 0, 2, 0}, {4, 1, 0, 2, 1, 5, 6, 0, 0, 2, 3}, {5, 1, 0, 2, 0, 7, 8, 0, 0, 2, 2},
+        {6, 1, 0, 0, 0, 7, 7, 1, 0, 4, 0}, {7, 2, 6, 0, 0, 5, 5, 1, 0, 2, 0},
+    };
+    if (mode >= 8) {
+        fprintf(fh, "reserved mode\n");
+        return;
+    }
+    char buf[16 * 8 + 7 + 1 + 1024]{};
+    auto &params = bc7_modes[mode];
+    char *p = buf;
+    int written = 0;
+
+    auto emit = [&](char ch) {
+        if (written && (written % 8) == 0) {
+            *p++ = ' ';
+        }
+        *p++ = ch;
+        ++written;
+    };
+
+    auto emit_n = [&](char ch, size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            emit(ch);
         }
-        return 1;
+    };
+
+    emit_n('M', mode + 1);
+    emit_n('P', params.partition_bits);
+    emit_n('R', params.rotation_bits);
+    emit_n('I', params.index_selection_bits);
+    emit_n('r', params.subsets * 2 * params.color_bits);
+    emit_n('g', params.subsets * 2 * params.color_bits);
+    emit_n('b', params.subsets * 2 * params.color_bits);
+    emit_n('a', params.subsets * 2 * params.alpha_bits);
+    emit_n('e', params.subsets * 2 * params.endpoint_p_bits);
+    emit_n('s', params.subsets * params.shared_p_bits);
+    if (params.index_bits_per_element) {
+        emit_n('1', 16 * params.index_bits_per_element - params.subsets);
+    }
+    if (params.secondary_index_bits_per_element) {
+        emit_n('2', 16 * params.secondary_index_bits_per_element - params.subsets);
     }
 
-    auto extent = srcTex.extent();
+    // flush out
+    fprintf(fh, "%s\n", buf);
+}
 
-    auto srcData = srcTex.data(0, 0, 0);
-    auto srcSize = srcTex.size(0);
-    std::vector<uint8_t> dstData(4 * extent.x * extent.y);
-    // bool success =
-    //     lv_bptc_decode(LV_BPTC_FORMAT_BC7_UNORM, extent.x, extent.y, srcData, srcSize, dstData.data(),
-    //     dstData.size());
+static void print_block_bits(FILE *fh, uint8_t const *p) {
+    char const *sep = "";
+    for (size_t i = 0; i < 16; ++i) {
+        fprintf(fh, "%s", sep);
+        sep = " ";
+        for (size_t j = 0; j < 8; ++j) {
+            fprintf(fh, "%d", (p[i] >> j) & 1);
+        }
+    }
+    fprintf(fh, "\n");
+}
 
-    struct BlockCoord {
-        int x, y;
+static void print_result(FILE *fh, uint8_t const *p) {
+    for (int y = 0; y < 4; ++y) {
+        for (int x = 0; x < 4; ++x) {
+            fprintf(fh, "%02X%02X%02X%02X ", p[3], p[0], p[1], p[2]);
+            p += 4;
+        }
+        fprintf(fh, "\n");
+    }
+}
 
-        auto operator<=>(BlockCoord const &) const = default;
-    };
+struct Mismatch {
+    std::string path;
+    size_t blockIndex;
+    std::array<uint8_t, 16> block;
+    std::array<uint8_t, 64> myPixels, theirPixels;
+};
 
-    int blockW = (extent.x + 3) / 4;
-    int blockH = (extent.y + 3) / 4;
+struct Totals {
+    size_t files{}, blocks{};
+    std::array<size_t, ModeCount> modeBlocks{}, modeMismatches{};
+    // Summed over threads.
+    double mySeconds{}, theirSeconds{};
+    // Files that were not verified, by format name or reason.
+    std::map<std::string, size_t> skipped;
+    std::vector<Mismatch> mismatches;
 
-    for (int blockY = 0; blockY < blockH; ++blockY) {
-        for (int blockX = 0; blockX < blockW; ++blockX) {
-            uint8_t const *blockData = (uint8_t const *)srcData + 16 * (blockX + blockY * blockW);
-            std::array<uint8_t, 4 * 4 * 4> my_pixels{}, their_pixels{};
-            lv_bptc_decode_block_bc7(blockData, my_pixels.data());
-            DecompressBlockBC7(blockData, their_pixels.data());
-            if (my_pixels != their_pixels) {
-                fprintf(stderr, "Decode mismatch in block (%d, %d) of file %s\n", blockX, blockY, srcPath.c_str());
-                return 1;
-            }
+    void Add(Totals const &other) {
+        files += other.files;
+        blocks += other.blocks;
+        for (int mode = 0; mode < ModeCount; ++mode) {
+            modeBlocks[mode] += other.modeBlocks[mode];
+            modeMismatches[mode] += other.modeMismatches[mode];
+        }
+        mySeconds += other.mySeconds;
+        theirSeconds += other.theirSeconds;
+        for (auto &[reason, count] : other.skipped) {
+            skipped[reason] += count;
+        }
+        // Files finish in any order, so the blocks kept are the first ones by path and position rather than the first
+        // ones to arrive, and reproducers from two runs can be compared.
+        mismatches.insert(mismatches.end(), other.mismatches.begin(), other.mismatches.end());
+        std::sort(mismatches.begin(), mismatches.end(), [](auto &a, auto &b) {
+            return std::tie(a.path, a.blockIndex) < std::tie(b.path, b.blockIndex);
+        });
+        if (mismatches.size() > MaxReproducerBlocks) {
+            mismatches.resize(MaxReproducerBlocks);
         }
     }
+};
 
-    auto print_block_header = [](FILE *fh, uint8_t mode) {
-        struct BC7Mode {
-            int mode;
-            int subsets;
-            int partition_bits;
-            int rotation_bits;
-            int index_selection_bits;
-            int color_bits;
-            int alpha_bits;
-            int endpoint_p_bits;
-            int shared_p_bits;
-            int index_bits_per_element;
-            int secondary_index_bits_per_element;
-        } bc7_modes[] = {
-            // Mode NS PB RB ISB CB AB EPB SPB IB IB2
-            // ---- -- -- -- --- -- -- --- --- -- ---
-            {0, 3, 4, 0, 0, 4, 0, 1, 0, 3, 0}, {1, 2, 6, 0, 0, 6, 0, 0, 1, 3, 0}, {2, 3, 6, 0, 0, 5, 0, 0, 0, 2, 0},
-            {3, 2, 6, 0, 0, 7, 0, 1, 0, 2, 0}, {4, 1, 0, 2, 1, 5, 6, 0, 0, 2, 3}, {5, 1, 0, 2, 0, 7, 8, 0, 0, 2, 2},
-            {6, 1, 0, 0, 0, 7, 7, 1, 0, 4, 0}, {7, 2, 6, 0, 0, 5, 5, 1, 0, 2, 0},
+// Decodes every block with both decoders a chunk at a time, alternating which goes first so that neither always gets
+// the blocks from cache, and compares the results.
+static void verify_blocks(std::string const &path, gsl::span<uint8_t const> data, Totals &totals) {
+    size_t blockCount = data.size() / 16;
+    std::vector<uint8_t> my_pixels(ChunkBlocks * 64), their_pixels(ChunkBlocks * 64);
+    for (size_t first = 0; first < blockCount; first += ChunkBlocks) {
+        size_t count = std::min(ChunkBlocks, blockCount - first);
+        uint8_t const *src = data.data() + first * 16;
+        auto decode_mine = [&] {
+            auto start = Clock::now();
+            for (size_t i = 0; i < count; ++i) {
+                lv_bptc_decode_block_bc7(src + i * 16, my_pixels.data() + i * 64);
+            }
+            totals.mySeconds += std::chrono::duration<double>(Clock::now() - start).count();
         };
-        char buf[16 * 8 + 7 + 1 + 1024]{};
-        auto &params = bc7_modes[mode];
-        char *p = buf;
-        int written = 0;
-
-        auto emit = [&](char ch) {
-            if (written && (written % 8) == 0) {
-                *p++ = ' ';
+        auto decode_theirs = [&] {
+            auto start = Clock::now();
+            for (size_t i = 0; i < count; ++i) {
+                DecompressBlockBC7(src + i * 16, their_pixels.data() + i * 64);
             }
-            *p++ = ch;
-            ++written;
+            totals.theirSeconds += std::chrono::duration<double>(Clock::now() - start).count();
         };
+        if ((first / ChunkBlocks) % 2) {
+            decode_theirs();
+            decode_mine();
+        } else {
+            decode_mine();
+            decode_theirs();
+        }
 
-        auto emit_n = [&](char ch, size_t n) {
-            for (size_t i = 0; i < n; ++i) {
-                emit(ch);
+        for (size_t i = 0; i < count; ++i) {
+            int mode = block_mode(src + i * 16);
+            ++totals.modeBlocks[mode];
+            if (memcmp(my_pixels.data() + i * 64, their_pixels.data() + i * 64, 64) != 0) {
+                ++totals.modeMismatches[mode];
+                if (totals.mismatches.size() < MaxReproducerBlocks) {
+                    Mismatch mismatch{path, first + i, {}, {}, {}};
+                    std::copy_n(src + i * 16, 16, mismatch.block.begin());
+                    std::copy_n(my_pixels.data() + i * 64, 64, mismatch.myPixels.begin());
+                    std::copy_n(their_pixels.data() + i * 64, 64, mismatch.theirPixels.begin());
+                    totals.mismatches.push_back(mismatch);
+                }
             }
-        };
+        }
+    }
+    totals.blocks += blockCount;
+}
 
-        emit_n('M', mode + 1);
-        emit_n('P', params.partition_bits);
-        emit_n('R', params.rotation_bits);
-        emit_n('I', params.index_selection_bits);
-        emit_n('r', params.subsets * 2 * params.color_bits);
-        emit_n('g', params.subsets * 2 * params.color_bits);
-        emit_n('b', params.subsets * 2 * params.color_bits);
-        emit_n('a', params.subsets * 2 * params.alpha_bits);
-        emit_n('e', params.subsets * 2 * params.endpoint_p_bits);
-        emit_n('s', params.subsets * params.shared_p_bits);
-        if (params.index_bits_per_element) {
-            emit_n('1', 16 * params.index_bits_per_element - params.subsets);
+// Every block of every level, face and layer of a BC7 texture. Other files are counted as skipped.
+static Totals verify_file(std::string const &path) {
+    Totals ret;
+    std::vector<uint8_t> file = ReadFile(path);
+    PixelBuffer unpacked;
+    gsl::span<uint8_t const> data = file;
+    switch (DetectPayload(data)) {
+    case PayloadKind::Plain:
+        break;
+    case PayloadKind::Compressed:
+        unpacked = DecompressPayload(data, path);
+        data = gsl::span<uint8_t const>(unpacked.data(), unpacked.size());
+        break;
+    case PayloadKind::Redirect:
+        ++ret.skipped["redirect"];
+        return ret;
+    }
+    auto tex = ParseDds(data);
+    if (!tex) {
+        ++ret.skipped["unknown format"];
+        return ret;
+    }
+    if (tex->format != gli::FORMAT_RGBA_BP_UNORM_BLOCK16 && tex->format != gli::FORMAT_RGBA_BP_SRGB_BLOCK16) {
+        auto I = known_formats.find(tex->format);
+        ++ret.skipped[I != known_formats.end() ? I->second : fmt::format("format {}", int(tex->format))];
+        return ret;
+    }
+    ++ret.files;
+    verify_blocks(path, tex->data.first(tex->DataSize()), ret);
+    return ret;
+}
+
+// The mismatching blocks in a row, as a BC7 texture that both decoders can be pointed at again, and what each decoder
+// made of them.
+static void write_reproducer(std::string const &path, std::vector<Mismatch> const &mismatches) {
+    auto file = WriteDdsHeader(gli::FORMAT_RGBA_BP_UNORM_BLOCK16, glm::ivec2(4 * int(mismatches.size()), 4), 1);
+    for (auto &mismatch : mismatches) {
+        file.insert(file.end(), mismatch.block.begin(), mismatch.block.end());
+    }
+    WriteFile(path, file);
+
+    std::string textPath = path + ".txt";
+    FILE *fh = fopen(textPath.c_str(), "w");
+    if (!fh) {
+        throw std::runtime_error(fmt::format("could not open {}", textPath));
+    }
+    for (size_t i = 0; i < mismatches.size(); ++i) {
+        auto &mismatch = mismatches[i];
+        fprintf(fh, "block %zu: %s block %zu, mode %d\n", i, mismatch.path.c_str(), mismatch.blockIndex,
+                block_mode(mismatch.block.data()));
+        print_block_header(fh, uint8_t(block_mode(mismatch.block.data())));
+        print_block_bits(fh, mismatch.block.data());
+        fprintf(fh, "lv_bptc:\n");
+        print_result(fh, mismatch.myPixels.data());
+        fprintf(fh, "CMP_Core:\n");
+        print_result(fh, mismatch.theirPixels.data());
+        fprintf(fh, "\n");
+    }
+    fclose(fh);
+}
+
+static std::vector<std::string> find_textures(std::vector<std::string> const &paths) {
+    namespace fs = std::filesystem;
+    std::vector<std::string> ret;
+    for (auto &path : paths) {
+        if (!fs::is_directory(path)) {
+            ret.push_back(path);
+            continue;
         }
-        if (params.secondary_index_bits_per_element) {
-            emit_n('2', 16 * params.secondary_index_bits_per_element - params.subsets);
+        for (auto &entry : fs::recursive_directory_iterator(path)) {
+            auto ext = entry.path().extension().string();
+            std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char ch) { return std::tolower(ch); });
+            if (entry.is_regular_file() && ext == ".dds") {
+                ret.push_back(entry.path().string());
+            }
         }
+    }
+    std::sort(ret.begin(), ret.end());
+    return ret;
+}
 
-        // flush out
-        fprintf(fh, "%s\n", buf);
-    };
+int main(int argc, char **argv) {
+    unsigned threads = std::max(std::thread::hardware_concurrency(), 1u);
+    std::string reproPath = "bptc_mismatches.dds";
+    std::vector<std::string> paths;
+    try {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if ((arg == "--threads" || arg == "--repro") && i + 1 < argc) {
+                if (arg == "--threads") {
+                    threads = unsigned(std::max(1, IntoInt(argv[++i])));
+                } else {
+                    reproPath = argv[++i];
+                }
+            } else if (arg.rfind("--", 0) == 0) {
+                paths.clear();
+                break;
+            } else {
+                paths.push_back(arg);
+            }
+        }
+        if (paths.empty()) {
+            fprintf(stderr, "%s [--threads N] [--repro PATH.dds] FILE|DIR...\n", argv[0]);
+            return 1;
+        }
 
-    auto print_block_bits = [](FILE *fh, uint8_t const *p) {
-        char const *sep = "";
-        for (size_t i = 0; i < 16; ++i) {
-            fprintf(fh, "%s", sep);
-            sep = " ";
-            for (size_t j = 0; j < 8; ++j) {
-                fprintf(fh, "%d", (p[i] >> j) & 1);
+        auto files = find_textures(paths);
+        Totals totals;
+        std::mutex mutex;
+        auto start = Clock::now();
+        {
+            ThreadPool pool(threads);
+            TaskGroup group(pool);
+            for (auto &file : files) {
+                group.Run([&] {
+                    Totals result;
+                    try {
+                        result = verify_file(file);
+                    } catch (std::exception &e) {
+                        fprintf(stderr, "warning: %s: %s\n", file.c_str(), e.what());
+                        ++result.skipped["unreadable"];
+                    }
+                    std::lock_guard lk(mutex);
+                    totals.Add(result);
+                });
             }
+            group.Wait();
         }
-        fprintf(fh, "\n");
-    };
-    auto print_result = [](FILE *fh, auto pixels) {
-        uint8_t const *p = pixels;
-        for (int y = 0; y < 4; ++y) {
-            for (int x = 0; x < 4; ++x) {
-                fprintf(fh, "%02X%02X%02X%02X ", p[3], p[0], p[1], p[2]);
-                p += 4;
+        double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+        size_t mismatchCount = 0;
+        for (auto count : totals.modeMismatches) {
+            mismatchCount += count;
+        }
+        printf("%zu BC7 textures, %zu blocks, %zu mismatches, %.2f s on %u thread%s\n", totals.files, totals.blocks,
+               mismatchCount, elapsed, threads, threads == 1 ? "" : "s");
+        printf("\n%-8s %12s %12s\n", "mode", "blocks", "mismatches");
+        for (int mode = 0; mode < ModeCount; ++mode) {
+            if (totals.modeBlocks[mode]) {
+                printf("%-8s %12zu %12zu\n", mode < 8 ? std::to_string(mode).c_str() : "reserved",
+                       totals.modeBlocks[mode], totals.modeMismatches[mode]);
             }
-            fprintf(fh, "\n");
         }
-    };
-}
\ No newline at end of file
+
+        // Rates per thread, from the time each decoder spent on its passes.
+        double megabytes = totals.blocks * 16 / 1e6;
+        printf("\n%-8s %12s %12s %14s\n", "decoder", "seconds", "MB/s", "Mblocks/s");
+        for (auto [name, seconds] : {std::pair{"lv_bptc", totals.mySeconds}, {"CMP_Core", totals.theirSeconds}}) {
+            printf("%-8s %12.3f %12.1f %14.2f\n", name, seconds, seconds > 0 ? megabytes / seconds : 0.0,
+                   seconds > 0 ? totals.blocks / 1e6 / seconds : 0.0);
+        }
+        if (totals.mySeconds > 0) {
+            printf("lv_bptc takes %.2fx the time of CMP_Core\n",
+                   totals.mySeconds / std::max(totals.theirSeconds, 1e-9));
+        }
+
+        if (!totals.skipped.empty()) {
+            printf("\nskipped:\n");
+            for (auto &[reason, count] : totals.skipped) {
+                printf("  %s: %zu\n", reason.c_str(), count);
+            }
+        }
+
+        if (!totals.mismatches.empty()) {
+            write_reproducer(reproPath, totals.mismatches);
+            printf("\n%zu mismatching blocks written to %s, details in %s.txt\n", totals.mismatches.size(),
+                   reproPath.c_str(), reproPath.c_str());
+        }
+        return mismatchCount ? 1 : 0;
+    } catch (std::exception &e) {
+        fprintf(stderr, "error: %s\n", e.what());
+    }
+    return 1;
+}
@@ -0,0 +1,152 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <string>
+
+#include "trace.h"
+
+namespace {
+// Identifies the pool and worker index of the current thread, so that nested submissions stay local.
+thread_local ThreadPool const *currentPool = nullptr;
+thread_local int currentWorker = -1;
+} // namespace
+
+ThreadPool::ThreadPool(unsigned threadCount) {
+    threadCount = std::max(threadCount, 1u);
+    for (unsigned i = 0; i < threadCount; ++i) {
+        workers.push_back(std::make_unique<Worker>());
+    }
+    for (unsigned i = 0; i < threadCount; ++i) {
+        threads.emplace_back([this, i] { WorkerMain(static_cast<int>(i)); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    Wait();
+    {
+        std::lock_guard lk(sleepMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto &thread : threads) {
+        thread.join();
+    }
+}
+
+void ThreadPool::Submit(Task task) {
+    int self = currentPool == this ? currentWorker : -1;
+    unsigned target = self >= 0 ? static_cast<unsigned>(self) : nextWorker++ % workers.size();
+
+    ++pending;
+    {
+        std::lock_guard lk(workers[target]->mutex);
+        workers[target]->tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard lk(sleepMutex);
+        ++queued;
+    }
+    wake.notify_one();
+    if (helping > 0) {
+        progress.notify_all();
+    }
+}
+
+bool ThreadPool::TryRunOne(int self) {
+    Task task;
+    size_t count = workers.size();
+    size_t start = self >= 0 ? static_cast<size_t>(self) : 0;
+    for (size_t i = 0; i < count && !task; ++i) {
+        auto &worker = *workers[(start + i) % count];
+        std::lock_guard lk(worker.mutex);
+        if (worker.tasks.empty()) {
+            continue;
+        }
+        // Own queue is used as a stack, other queues are stolen from at the far end.
+        if (i == 0 && self >= 0) {
+            task = std::move(worker.tasks.back());
+            worker.tasks.pop_back();
+        } else {
+            task = std::move(worker.tasks.front());
+            worker.tasks.pop_front();
+        }
+    }
+    if (!task) {
+        return false;
+    }
+
+    {
+        std::lock_guard lk(sleepMutex);
+        --queued;
+    }
+    task();
+    bool last = --pending == 0;
+    if (last || helping > 0) {
+        std::lock_guard lk(sleepMutex);
+        if (last) {
+            idle.notify_all();
+        }
+        progress.notify_all();
+    }
+    return true;
+}
+
+void ThreadPool::WorkerMain(int index) {
+    currentPool = this;
+    currentWorker = index;
+    SetTraceThreadName("pool " + std::to_string(index));
+    while (true) {
+        if (TryRunOne(index)) {
+            continue;
+        }
+        std::unique_lock lk(sleepMutex);
+        wake.wait(lk, [&] { return queued > 0 || stopping; });
+        if (stopping && queued == 0) {
+            return;
+        }
+    }
+}
+
+void ThreadPool::HelpUntil(std::function<bool()> const &done) {
+    int self = currentPool == this ? currentWorker : -1;
+    while (!done()) {
+        if (TryRunOne(self)) {
+            continue;
+        }
+        // Nothing to steal, so sleep until a task finishes, which may be the last one `done` waits for, or more work
+        // is queued. Announcing the wait before checking `done` means a task that finishes in between sees it.
+        std::unique_lock lk(sleepMutex);
+        ++helping;
+        progress.wait(lk, [&] { return queued > 0 || done(); });
+        --helping;
+    }
+}
+
+void ThreadPool::Wait() {
+    std::unique_lock lk(sleepMutex);
+    idle.wait(lk, [&] { return pending == 0; });
+}
+
+TaskGroup::~TaskGroup() { pool.HelpUntil([&] { return outstanding == 0; }); }
+
+void TaskGroup::Run(ThreadPool::Task task) {
+    ++outstanding;
+    pool.Submit([this, task = std::move(task)] {
+        try {
+            task();
+        } catch (...) {
+            std::lock_guard lk(errorMutex);
+            if (!error) {
+                error = std::current_exception();
+            }
+        }
+        --outstanding;
+    });
+}
+
+void TaskGroup::Wait() {
+    pool.HelpUntil([&] { return outstanding == 0; });
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
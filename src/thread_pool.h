@@ -0,0 +1,80 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing thread pool. Each worker owns a queue of tasks and runs its own newest task first, taking the oldest
+// task from another worker's queue when its own runs dry. Tasks submitted from inside a worker go to that worker's
+// queue, so work a task splits off stays local unless someone else is idle.
+class ThreadPool {
+  public:
+    using Task = std::function<void()>;
+
+    explicit ThreadPool(unsigned threadCount);
+    ~ThreadPool();
+
+    ThreadPool(ThreadPool const &) = delete;
+    ThreadPool &operator=(ThreadPool const &) = delete;
+
+    unsigned ThreadCount() const { return static_cast<unsigned>(threads.size()); }
+
+    void Submit(Task task);
+
+    // Runs queued tasks on the calling thread until `done` returns true, sleeping while there is nothing to run.
+    // `done` is checked again whenever a task finishes, so it must only depend on state that tasks change.
+    void HelpUntil(std::function<bool()> const &done);
+
+    // Blocks until every submitted task has finished.
+    void Wait();
+
+  private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    bool TryRunOne(int self);
+    void WorkerMain(int index);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threads;
+
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    std::condition_variable progress;
+    size_t queued{};
+    bool stopping{};
+
+    std::atomic<size_t> pending{0};
+    // Threads asleep in HelpUntil, so that finishing a task only takes the lock when someone waits on it.
+    std::atomic<unsigned> helping{0};
+    std::atomic<unsigned> nextWorker{0};
+};
+
+// Tracks a set of tasks spawned for one job so that the spawner can wait for just those, helping out with queued
+// work in the meantime. The first exception thrown by any of the tasks is rethrown from Wait.
+class TaskGroup {
+  public:
+    explicit TaskGroup(ThreadPool &pool) : pool(pool) {}
+    ~TaskGroup();
+
+    void Run(ThreadPool::Task task);
+    void Wait();
+
+  private:
+    ThreadPool &pool;
+    std::atomic<size_t> outstanding{0};
+    std::mutex errorMutex;
+    std::exception_ptr error;
+};
+
+#endif // THREAD_POOL_H
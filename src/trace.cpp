@@ -0,0 +1,117 @@
+#include "trace.h"
+
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include "convert.h"
+#include "info.h"
+
+std::atomic<bool> traceEnabled{false};
+
+namespace {
+// Spans kept per thread, about 1.5 MiB of events, allocated only for threads that record while tracing.
+constexpr size_t RingCapacity = 1 << 16;
+
+struct Span {
+    char const *name;
+    int64_t beginNs;
+    int64_t endNs;
+};
+
+struct ThreadTrace {
+    std::array<Span, RingCapacity> spans;
+    // Spans ever recorded, of which the last RingCapacity are in the ring. Only the owning thread writes it.
+    std::atomic<uint64_t> recorded{0};
+    std::string name;
+    int tid{};
+};
+
+std::mutex threadsMutex;
+// Kept past the end of their threads, so that short-lived threads still show up.
+std::vector<std::unique_ptr<ThreadTrace>> threads;
+int64_t traceStartNs;
+
+int64_t NowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+// The calling thread's ring, registered on first use.
+ThreadTrace &CurrentThread() {
+    thread_local ThreadTrace *current = nullptr;
+    if (!current) {
+        auto trace = std::make_unique<ThreadTrace>();
+        std::lock_guard lk(threadsMutex);
+        trace->tid = static_cast<int>(threads.size()) + 1;
+        current = threads.emplace_back(std::move(trace)).get();
+    }
+    return *current;
+}
+} // namespace
+
+void EnableTrace() {
+    traceStartNs = NowNs();
+    traceEnabled = true;
+    SetTraceThreadName("main");
+}
+
+void SetTraceThreadName(std::string name) {
+    if (TraceEnabled()) {
+        CurrentThread().name = std::move(name);
+    }
+}
+
+void RecordSpan(char const *name, int64_t beginNs, int64_t endNs) {
+    if (!TraceEnabled()) {
+        return;
+    }
+    auto &thread = CurrentThread();
+    uint64_t index = thread.recorded.load(std::memory_order_relaxed);
+    thread.spans[index % RingCapacity] = Span{name, beginNs, endNs};
+    thread.recorded.store(index + 1, std::memory_order_release);
+}
+
+static std::string FormatTrace(uint64_t &dropped) {
+    std::lock_guard lk(threadsMutex);
+    // Chrome trace timestamps are in microseconds.
+    auto micros = [](int64_t ns) { return (ns - traceStartNs) / 1e3; };
+    std::string out = "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    char const *sep = "";
+    for (auto &thread : threads) {
+        if (!thread->name.empty()) {
+            out += fmt::format("{}{{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": {}, \"args\": "
+                               "{{\"name\": {}}}}}",
+                               sep, thread->tid, JsonString(thread->name));
+            sep = ",\n";
+        }
+        uint64_t recorded = thread->recorded.load(std::memory_order_acquire);
+        uint64_t first = recorded > RingCapacity ? recorded - RingCapacity : 0;
+        dropped += first;
+        for (uint64_t i = first; i < recorded; ++i) {
+            auto const &span = thread->spans[i % RingCapacity];
+            out += fmt::format("{}{{\"name\": \"{}\", \"ph\": \"X\", \"pid\": 1, \"tid\": {}, \"ts\": {:.3f}, "
+                               "\"dur\": {:.3f}}}",
+                               sep, span.name, thread->tid, micros(span.beginNs),
+                               (span.endNs - span.beginNs) / 1e3);
+            sep = ",\n";
+        }
+    }
+    out += "\n]}\n";
+    return out;
+}
+
+void WriteTrace(std::string const &path) {
+    uint64_t dropped = 0;
+    std::string out = FormatTrace(dropped);
+    if (dropped) {
+        fprintf(stderr, "warning: trace rings overflowed, the oldest %ju spans were dropped\n", uintmax_t(dropped));
+    }
+    WriteFile(path, gsl::span<uint8_t const>(reinterpret_cast<uint8_t const *>(out.data()), out.size()));
+}
@@ -0,0 +1,29 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Timeline of what each thread was doing, written as Chrome trace events for chrome://tracing or Perfetto.
+//
+// Every thread records its spans into a fixed size ring of its own without locking, so recording does not serialise
+// the threads it is meant to observe. A thread that records more spans than its ring holds loses its oldest ones.
+
+extern std::atomic<bool> traceEnabled;
+
+// Nothing is recorded until tracing is enabled, and until then recording costs a relaxed load and a branch.
+inline bool TraceEnabled() { return traceEnabled.load(std::memory_order_relaxed); }
+void EnableTrace();
+
+// Names the calling thread in the trace, such as after the pipeline stage it runs.
+void SetTraceThreadName(std::string name);
+
+// Records a span on the calling thread, with times from std::chrono::steady_clock in nanoseconds. The name must be a
+// string literal or otherwise outlive the trace.
+void RecordSpan(char const *name, int64_t beginNs, int64_t endNs);
+
+// Writes the spans of all threads. Threads must have stopped recording by then.
+void WriteTrace(std::string const &path);
+
+#endif // TRACE_H